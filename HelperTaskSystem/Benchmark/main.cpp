@@ -0,0 +1,1148 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+#include <algorithm>
+#include <string.h>
+#include "../HelperTaskSystem.hpp"
+#include "../ParallelFor.hpp"
+
+#if SYSTEM_WINDOWS
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+/**
+* Scheduler benchmark suite
+* 
+* Every benchmark collects one sample per run, reports p50, p99, max and mean over the samples and
+* the cost per item for throughput benchmarks. Latency benchmarks take one sample per probe.
+* 
+* Usage: Benchmark [--json] [--pin] [--filter <substring>] [--runs <count>]
+* 
+* --json prints a single JSON array instead of the table so results can be compared between builds.
+* --pin pins the helpers one per cpu so stealing follows the cpu topology, build with
+* BUILD_LINEAR_STEAL_ORDER to compare against a plain scan over the workers.
+*/
+
+struct BenchmarkOptions
+{
+	Bool json;
+	Bool pin;
+	const char* filter;
+	U32 runs;
+};
+
+struct BenchmarkResult
+{
+	const char* name;
+	U32 items;
+	std::vector<I64> samples;
+};
+
+static std::vector<BenchmarkResult> results;
+static BenchmarkOptions options;
+
+static Bool Selected(const char* name)
+{
+	return options.filter == nullptr || strstr(name, options.filter) != nullptr;
+}
+
+static I64 Percentile(const std::vector<I64>& sorted, U32 percent)
+{
+	return sorted[(sorted.size() - 1) * percent / 100];
+}
+
+static void Report(const char* name, U32 items, std::vector<I64>& samples)
+{
+	std::sort(samples.begin(), samples.end());
+
+	I64 sum = 0;
+	for (U32 i = 0; i < samples.size(); i++)
+		sum += samples[i];
+
+	BenchmarkResult result;
+	result.name = name;
+	result.items = items;
+	result.samples = samples;
+	results.push_back(result);
+
+	if (options.json)
+		return;
+
+	I64 p50 = Percentile(samples, 50);
+
+	std::cout << name << " - p50: " << p50 << " ns, p99: " << Percentile(samples, 99) << " ns, max: " <<
+		samples.back() << " ns, mean: " << sum / (I64)samples.size() << " ns";
+
+	if (items > 1)
+		std::cout << ", " << (F64)p50 / (F64)items << " ns/item at p50";
+
+	std::cout << "\n";
+}
+
+static void PrintJson()
+{
+	std::cout << "[\n";
+
+	for (U32 i = 0; i < results.size(); i++)
+	{
+		std::vector<I64>& samples = results[i].samples;
+
+		I64 sum = 0;
+		for (U32 j = 0; j < samples.size(); j++)
+			sum += samples[j];
+
+		std::cout << "\t{\"name\": \"" << results[i].name << "\", \"items\": " << results[i].items <<
+			", \"samples\": " << samples.size() << ", \"p50_ns\": " << Percentile(samples, 50) <<
+			", \"p99_ns\": " << Percentile(samples, 99) << ", \"max_ns\": " << samples.back() <<
+			", \"mean_ns\": " << sum / (I64)samples.size() << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+
+	std::cout << "]\n";
+}
+
+static I64 Now()
+{
+	return Clock::now().time_since_epoch().count();
+}
+
+// User and kernel time of all threads of the process
+static I64 ProcessCpuTime()
+{
+#if SYSTEM_WINDOWS
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+
+	U64 kernelTime = ((U64)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+	U64 userTime = ((U64)user.dwHighDateTime << 32) | user.dwLowDateTime;
+	return (I64)(kernelTime + userTime) * 100;
+#else
+	timespec time;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+	return (I64)time.tv_sec * 1000000000 + time.tv_nsec;
+#endif
+}
+
+
+// Empty task throughput
+
+static void EmptyTasks(WorkerBase* worker)
+{
+	const char* name = "empty tasks, submit and wait";
+	const U32 count = 0x10000;
+
+	if (!Selected(name))
+		return;
+
+	std::vector<I64> samples;
+
+	for (U32 run = 0; run < options.runs; run++)
+	{
+		I64 start = Now();
+
+		TaskHandle join = worker->NewTask(nullptr, nullptr, TaskHandle(), TaskHandle());
+
+		for (U32 i = 0; i < count; i++)
+			worker->SubmitTask(worker->NewTask(nullptr, nullptr, TaskHandle(), join));
+
+		worker->SubmitTask(join);
+		worker->WaitOnTask(join);
+
+		samples.push_back(Now() - start);
+	}
+
+	Report(name, count, samples);
+}
+
+
+// Fork-join fib
+
+enum { FibCutoff = 12 };
+
+struct FibArgs
+{
+	U32 n;
+	U64 result;
+};
+
+static U64 SerialFib(U32 n)
+{
+	return n < 2 ? n : SerialFib(n - 1) + SerialFib(n - 2);
+}
+
+// Spawns n - 1, computes n - 2 itself and helps out until the child finished
+static void FibTask(WorkerBase* worker, void* args)
+{
+	FibArgs* fib = (FibArgs*)args;
+
+	if (fib->n < FibCutoff)
+	{
+		fib->result = SerialFib(fib->n);
+		return;
+	}
+
+	FibArgs left = { fib->n - 1, 0 };
+	FibArgs right = { fib->n - 2, 0 };
+
+	TaskHandle child = worker->NewTask(&FibTask, &left, TaskHandle(), TaskHandle());
+	worker->SubmitTask(child);
+
+	FibTask(worker, &right);
+	worker->WaitOnTask(child);
+
+	fib->result = left.result + right.result;
+}
+
+static void Fib(WorkerBase* worker)
+{
+	const char* name = "fork-join fib(30)";
+
+	if (!Selected(name))
+		return;
+
+	std::vector<I64> samples;
+	U64 expected = SerialFib(30);
+
+	for (U32 run = 0; run < options.runs; run++)
+	{
+		FibArgs root = { 30, 0 };
+		I64 start = Now();
+
+		TaskHandle task = worker->NewTask(&FibTask, &root, TaskHandle(), TaskHandle());
+		worker->SubmitTask(task);
+		worker->WaitOnTask(task);
+
+		samples.push_back(Now() - start);
+
+		if (root.result != expected)
+			std::cerr << name << ": result mismatch!\n";
+	}
+
+	Report(name, 1, samples);
+}
+
+
+// ParallelFor over an array
+
+struct ScaleBody
+{
+	F32* values;
+
+	void operator()(I64 i) const
+	{
+		values[i] = values[i] * 2.0f + 1.0f;
+	}
+};
+
+static void ParallelForArray(WorkerBase* worker)
+{
+	const char* name = "parallel-for, 0x1000000 floats";
+	const U32 count = 0x1000000;
+
+	if (!Selected(name))
+		return;
+
+	std::vector<I64> samples;
+	ScaleBody body;
+	body.values = Allocate<F32>(count);
+
+	for (U32 i = 0; i < count; i++)
+		body.values[i] = 0.0f;
+
+	for (U32 run = 0; run < options.runs; run++)
+	{
+		I64 start = Now();
+		ParallelFor(worker, 0, count, 0x1000, body);
+		samples.push_back(Now() - start);
+	}
+
+	Free(body.values);
+	Report(name, count, samples);
+}
+
+
+// Dependency chain
+
+struct ChainLink
+{
+	std::atomic<U32>* counter;
+	U32 position;
+	Bool* failed;
+};
+
+static void ChainTask(WorkerBase* worker, void* args)
+{
+	ChainLink* link = (ChainLink*)args;
+
+	if (link->counter->fetch_add(1, std::memory_order_relaxed) != link->position)
+		*link->failed = 1;
+}
+
+static void DependencyChain(WorkerBase* worker)
+{
+	const char* name = "dependency chain, 0x10000 tasks";
+	const U32 count = 0x10000;
+
+	if (!Selected(name))
+		return;
+
+	std::vector<I64> samples;
+	ChainLink* links = Allocate<ChainLink>(count);
+	std::atomic<U32> counter(0);
+	Bool failed = 0;
+
+	for (U32 run = 0; run < options.runs; run++)
+	{
+		counter.store(0, std::memory_order_relaxed);
+		I64 start = Now();
+
+		TaskHandle first = TaskHandle(), last = TaskHandle();
+
+		for (U32 i = 0; i < count; i++)
+		{
+			links[i].counter = &counter;
+			links[i].position = i;
+			links[i].failed = &failed;
+
+			TaskHandle task = worker->NewTask(&ChainTask, links + i, last, TaskHandle());
+
+			if (i == 0)
+				first = task;
+			else
+				worker->SubmitTask(task);
+
+			last = task;
+		}
+
+		worker->SubmitTask(first);
+		worker->WaitOnTask(last);
+
+		samples.push_back(Now() - start);
+	}
+
+	if (failed || counter.load(std::memory_order_relaxed) != count)
+		std::cerr << name << ": order mismatch!\n";
+
+	Free(links);
+	Report(name, count, samples);
+}
+
+
+// Fan-in
+
+static void CountTask(WorkerBase* worker, void* counter)
+{
+	((std::atomic<U32>*)counter)->fetch_add(1, std::memory_order_relaxed);
+}
+
+static void CheckCountTask(WorkerBase* worker, void* args)
+{
+	std::atomic<U32>* counter = (std::atomic<U32>*)args;
+
+	if (counter->load(std::memory_order_relaxed) != 0x4000)
+		std::cerr << "fan-in: final task ran before all of its dependencies!\n";
+}
+
+static void FanIn(WorkerBase* worker)
+{
+	const char* name = "fan-in, 0x4000 dependencies of one task";
+	const U32 count = 0x4000;
+
+	if (!Selected(name))
+		return;
+
+	std::vector<I64> samples;
+	std::atomic<U32> counter(0);
+
+	for (U32 run = 0; run < options.runs; run++)
+	{
+		counter.store(0, std::memory_order_relaxed);
+		I64 start = Now();
+
+		TaskHandle sink = worker->NewTask(&CheckCountTask, &counter, TaskHandle(), TaskHandle());
+
+		for (U32 i = 0; i < count; i++)
+		{
+			TaskHandle task = worker->NewTask(&CountTask, &counter, TaskHandle(), TaskHandle());
+			worker->AddDependency(sink, task);
+			worker->SubmitTask(task);
+		}
+
+		worker->SubmitTask(sink);
+		worker->WaitOnTask(sink);
+
+		samples.push_back(Now() - start);
+	}
+
+	Report(name, count, samples);
+}
+
+
+// Deep task trees
+
+// Every link spawns the next one as its own child, so the chain is depth tasks deep
+static void NestedLinkTask(WorkerBase* worker, void* args)
+{
+	UPtr depth = (UPtr)args;
+
+	if (depth != 0)
+		worker->SubmitTask(worker->NewTask(&NestedLinkTask, (void*)(depth - 1), TaskHandle(),
+			worker->CurrentTask()));
+}
+
+static void DeepTrees(WorkerBase* worker)
+{
+	const char* name = "deep trees, 0x400 chains of 0x100 nested children";
+	const U32 chains = 0x400;
+	const U32 depth = 0x100;
+
+	if (!Selected(name))
+		return;
+
+	std::vector<I64> samples;
+
+	for (U32 run = 0; run < options.runs; run++)
+	{
+		I64 start = Now();
+
+		TaskHandle root = worker->NewTask(nullptr, nullptr, TaskHandle(), TaskHandle());
+
+		for (U32 i = 0; i < chains; i++)
+			worker->SubmitTask(worker->NewTask(&NestedLinkTask, (void*)(UPtr)depth, TaskHandle(), root));
+
+		worker->SubmitTask(root);
+		worker->WaitOnTask(root);
+
+		samples.push_back(Now() - start);
+	}
+
+	Report(name, chains * (depth + 1), samples);
+}
+
+
+// Steal heavy fan-out
+
+// A bit of work that only touches the stack, so steals and not shared counters dominate
+static void LocalWorkTask(WorkerBase* worker, void* args)
+{
+	volatile U32 sum = 0;
+
+	for (U32 i = 0; i < 0x40; i++)
+		sum = sum + i;
+}
+
+// All children land in the deque of the spawning worker, everybody else has to steal them
+static void SpawnTask(WorkerBase* worker, void* args)
+{
+	TaskHandle self = worker->CurrentTask();
+
+	for (U32 i = 0; i < 0x10000; i++)
+		worker->SubmitTask(worker->NewTask(&LocalWorkTask, nullptr, TaskHandle(), self));
+}
+
+static void StealFanOut(WorkerBase* worker)
+{
+	const char* name = "steal, 0x10000 tasks spawned by one task";
+
+	if (!Selected(name))
+		return;
+
+	std::vector<I64> samples;
+
+	for (U32 run = 0; run < options.runs; run++)
+	{
+		I64 start = Now();
+
+		TaskHandle root = worker->NewTask(&SpawnTask, nullptr, TaskHandle(), TaskHandle());
+		worker->SubmitTask(root);
+		worker->WaitOnTask(root);
+
+		samples.push_back(Now() - start);
+	}
+
+	Report(name, 0x10000, samples);
+}
+
+// Scaling with the worker count
+
+// One submitter queues far more tasks than a deque starts out with, every other worker has to
+// take its share from the submitter, samples a system of 4 up to 128 workers
+static void Scaling()
+{
+	static const char* names[] =
+	{
+		"scaling, 0x40000 tasks from one submitter, 4 workers",
+		"scaling, 0x40000 tasks from one submitter, 16 workers",
+		"scaling, 0x40000 tasks from one submitter, 64 workers",
+		"scaling, 0x40000 tasks from one submitter, 128 workers",
+	};
+
+	static const U32 workerCounts[] = { 4, 16, 64, 128 };
+	const U32 count = 0x40000;
+
+	for (U32 i = 0; i < sizeof(workerCounts) / sizeof(workerCounts[0]); i++)
+	{
+		if (!Selected(names[i]))
+			continue;
+
+		HelperTaskSystemConfig config;
+		config.workerCount = workerCounts[i];
+
+		WorkerBase* worker;
+		HelperTaskSystem taskSystem(config, &worker);
+		std::vector<I64> samples;
+
+		for (U32 run = 0; run < options.runs; run++)
+		{
+			I64 start = Now();
+
+			TaskHandle join = worker->NewTask(nullptr, nullptr, TaskHandle(), TaskHandle());
+
+			for (U32 j = 0; j < count; j++)
+				worker->SubmitTask(worker->NewTask(&LocalWorkTask, nullptr, TaskHandle(), join));
+
+			worker->SubmitTask(join);
+			worker->WaitOnTask(join);
+
+			samples.push_back(Now() - start);
+		}
+
+		Report(names[i], count, samples);
+	}
+}
+
+// Scratch allocation
+
+// Every task fills a few temporary buffers of 64 to 2048 bytes and throws them away again
+static void MallocScratchTask(WorkerBase* worker, void* args)
+{
+	U32* buffers[8];
+
+	for (U32 i = 0; i < 8; i++)
+	{
+		UPtr size = (UPtr)64 << (i % 6);
+		buffers[i] = (U32*)malloc(size);
+		memset(buffers[i], (int)i, size);
+	}
+
+	volatile U32 sum = 0;
+
+	for (U32 i = 0; i < 8; i++)
+	{
+		sum = sum + buffers[i][i];
+		free(buffers[i]);
+	}
+}
+
+static void ArenaScratchTask(WorkerBase* worker, void* args)
+{
+	U32* buffers[8];
+
+	for (U32 i = 0; i < 8; i++)
+	{
+		UPtr size = (UPtr)64 << (i % 6);
+		buffers[i] = (U32*)worker->AllocateScratch(size, alignof(U32));
+		memset(buffers[i], (int)i, size);
+	}
+
+	volatile U32 sum = 0;
+
+	for (U32 i = 0; i < 8; i++)
+		sum = sum + buffers[i][i];
+}
+
+static void ScratchAllocation(WorkerBase* worker)
+{
+	static const char* names[] =
+	{
+		"scratch, 0x10000 tasks with 8 temporary buffers, malloc",
+		"scratch, 0x10000 tasks with 8 temporary buffers, worker arena",
+	};
+
+	static const TaskFunction functions[] = { &MallocScratchTask, &ArenaScratchTask };
+	const U32 count = 0x10000;
+
+	for (U32 i = 0; i < 2; i++)
+	{
+		if (!Selected(names[i]))
+			continue;
+
+		std::vector<I64> samples;
+
+		for (U32 run = 0; run < options.runs; run++)
+		{
+			I64 start = Now();
+
+			TaskHandle join = worker->NewTask(nullptr, nullptr, TaskHandle(), TaskHandle());
+
+			for (U32 j = 0; j < count; j++)
+				worker->SubmitTask(worker->NewTask(functions[i], nullptr, TaskHandle(), join));
+
+			worker->SubmitTask(join);
+			worker->WaitOnTask(join);
+
+			samples.push_back(Now() - start);
+		}
+
+		Report(names[i], count, samples);
+	}
+}
+
+// Mixed priorities
+
+struct PriorityTest
+{
+	std::atomic<U32> stop;
+	std::atomic<U32> running;
+	std::atomic<U32> done;
+	U32 loadPriority;
+	I64* submitted;
+	I64* latencies;
+};
+
+struct PriorityProbe
+{
+	PriorityTest* test;
+	U32 slot;
+};
+
+// Runs for 20us and queues the next one until the test stops
+static void PriorityLoadTask(WorkerBase* worker, void* args)
+{
+	PriorityTest* test = (PriorityTest*)args;
+	I64 start = Now();
+
+	while (Now() - start < 20000);
+
+	if (test->stop.load(std::memory_order_acquire) != 0)
+	{
+		test->running.fetch_sub(1, std::memory_order_release);
+		return;
+	}
+
+	TaskHandle next = worker->NewTask(&PriorityLoadTask, test, TaskHandle(), TaskHandle());
+	worker->SetPriority(next, test->loadPriority);
+	worker->SubmitTask(next);
+}
+
+static void PriorityProbeTask(WorkerBase* worker, void* args)
+{
+	PriorityProbe* probe = (PriorityProbe*)args;
+	PriorityTest* test = probe->test;
+
+	test->latencies[probe->slot] = Now() - test->submitted[probe->slot];
+	test->done.fetch_add(1, std::memory_order_release);
+}
+
+static void MixedPriorities(WorkerBase* worker, U32 workerCount, const char* name, U32 loadPriority,
+	U32 probePriority)
+{
+	const U32 probeCount = 0x200;
+
+	if (!Selected(name))
+		return;
+
+	PriorityTest test;
+	test.stop.store(0, std::memory_order_relaxed);
+	test.running.store(workerCount * 2, std::memory_order_relaxed);
+	test.done.store(0, std::memory_order_relaxed);
+	test.loadPriority = loadPriority;
+	test.submitted = Allocate<I64>(probeCount);
+	test.latencies = Allocate<I64>(probeCount);
+
+	PriorityProbe* probes = Allocate<PriorityProbe>(probeCount);
+
+	for (U32 i = 0; i < workerCount * 2; i++)
+	{
+		TaskHandle task = worker->NewTask(&PriorityLoadTask, &test, TaskHandle(), TaskHandle());
+		worker->SetPriority(task, loadPriority);
+		worker->SubmitTask(task);
+	}
+
+	for (U32 i = 0; i < probeCount; i++)
+	{
+		I64 start = Now();
+		while (Now() - start < 100000);
+
+		probes[i].test = &test;
+		probes[i].slot = i;
+
+		TaskHandle task = worker->NewTask(&PriorityProbeTask, probes + i, TaskHandle(), TaskHandle());
+		worker->SetPriority(task, probePriority);
+		test.submitted[i] = Now();
+		worker->SubmitTask(task);
+	}
+
+	test.stop.store(1, std::memory_order_release);
+
+	while (test.running.load(std::memory_order_acquire) != 0 || test.done.load(std::memory_order_acquire) != probeCount)
+		std::this_thread::yield();
+
+	std::vector<I64> samples(test.latencies, test.latencies + probeCount);
+
+	Free(probes);
+	Free(test.latencies);
+	Free(test.submitted);
+
+	Report(name, 1, samples);
+}
+
+
+// Wake latency
+
+struct WakeProbe
+{
+	I64 submitted;
+	std::atomic<I64> latency;
+};
+
+static void WakeProbeTask(WorkerBase* worker, void* args)
+{
+	WakeProbe* probe = (WakeProbe*)args;
+	probe->latency.store(Now() - probe->submitted, std::memory_order_release);
+}
+
+// Every probe is submitted once all helpers went through their spin window and parked
+static void WakeLatency(WorkerBase* worker, U32 spinNanoseconds)
+{
+	const char* name = "wake latency, all workers parked";
+
+	if (!Selected(name))
+		return;
+
+	std::vector<I64> samples;
+
+	for (U32 i = 0; i < 0x100; i++)
+	{
+		std::this_thread::sleep_for(std::chrono::nanoseconds((I64)spinNanoseconds + 1000000));
+
+		WakeProbe probe;
+		probe.latency.store(-1, std::memory_order_relaxed);
+
+		TaskHandle task = worker->NewTask(&WakeProbeTask, &probe, TaskHandle(), TaskHandle());
+		probe.submitted = Now();
+		worker->SubmitTask(task);
+
+		// the main thread must not run the probe itself
+		while (probe.latency.load(std::memory_order_acquire) < 0)
+			std::this_thread::yield();
+
+		samples.push_back(probe.latency.load(std::memory_order_relaxed));
+	}
+
+	Report(name, 1, samples);
+}
+
+// Burst ramp up
+
+struct BurstProbe
+{
+	std::atomic<I64> lastStart;
+	std::atomic<U32> started;
+};
+
+static void BurstTask(WorkerBase* worker, void* args)
+{
+	BurstProbe* probe = (BurstProbe*)args;
+	I64 start = Now();
+	I64 last = probe->lastStart.load(std::memory_order_relaxed);
+
+	while (last < start && !probe->lastStart.compare_exchange_weak(last, start, std::memory_order_relaxed));
+
+	probe->started.fetch_add(1, std::memory_order_release);
+
+	// hold the worker like real work would, so the burst has to spread over all of them
+	while (Now() - start < 200000);
+}
+
+// A burst of one task per helper hits a pool where every helper parked, samples the time until the
+// last of them started running
+static void BurstRampUp(WorkerBase* worker, U32 workerCount, U32 spinNanoseconds)
+{
+	const char* name = "burst ramp up, all workers parked";
+
+	if (!Selected(name))
+		return;
+
+	std::vector<I64> samples;
+	std::vector<TaskHandle> tasks(workerCount - 1);
+	std::vector<void*> args(workerCount - 1);
+
+	for (U32 i = 0; i < 0x40; i++)
+	{
+		std::this_thread::sleep_for(std::chrono::nanoseconds((I64)spinNanoseconds + 1000000));
+
+		BurstProbe probe;
+		probe.lastStart.store(0, std::memory_order_relaxed);
+		probe.started.store(0, std::memory_order_relaxed);
+
+		for (U32 j = 0; j < args.size(); j++)
+			args[j] = &probe;
+
+		worker->NewTasks((U32)tasks.size(), &BurstTask, args.data(), TaskHandle(), tasks.data());
+
+		I64 submitted = Now();
+		worker->SubmitTasks(tasks.data(), (U32)tasks.size());
+
+		// the main thread must not run the burst itself
+		while (probe.started.load(std::memory_order_acquire) != tasks.size())
+			std::this_thread::yield();
+
+		samples.push_back(probe.lastStart.load(std::memory_order_relaxed) - submitted);
+	}
+
+	Report(name, 1, samples);
+}
+
+// Idle cpu
+
+// A mostly idle service, one tiny task per millisecond, samples the cpu time burnt per millisecond
+static void IdleCpu(WorkerBase* worker)
+{
+	const char* name = "idle cpu per 1ms, one task per ms";
+
+	if (!Selected(name))
+		return;
+
+	std::vector<I64> samples;
+	std::atomic<U32> counter(0);
+
+	for (U32 i = 0; i < 0x100; i++)
+	{
+		I64 cpuStart = ProcessCpuTime();
+
+		worker->SubmitTask(worker->NewTask(&CountTask, &counter, TaskHandle(), TaskHandle()));
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		samples.push_back(ProcessCpuTime() - cpuStart);
+	}
+
+	Report(name, 1, samples);
+}
+
+// Blocked waiter
+
+static void LongTask(WorkerBase* worker, void* args)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+
+// The caller waits on a task that blocks for 10ms on a helper, samples the cpu time the process burnt
+// meanwhile
+static void BlockedWaiter(WorkerBase* worker)
+{
+	const char* name = "cpu while waiting on a 10ms task";
+
+	if (!Selected(name))
+		return;
+
+	std::vector<I64> samples;
+
+	for (U32 run = 0; run < options.runs; run++)
+	{
+		TaskHandle task = worker->NewTask(&LongTask, nullptr, TaskHandle(), TaskHandle());
+		I64 cpuStart = ProcessCpuTime();
+
+		worker->SubmitTask(task);
+
+		// leave the task to a helper, the caller would run it itself otherwise
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		worker->WaitOnTask(task);
+
+		samples.push_back(ProcessCpuTime() - cpuStart);
+	}
+
+	Report(name, 1, samples);
+}
+
+// Timers
+
+struct TimerProbe
+{
+	std::atomic<I64> fired;
+	std::atomic<U32> remaining;
+};
+
+static void TimerProbeTask(WorkerBase* worker, void* args)
+{
+	((TimerProbe*)args)->fired.store(Now(), std::memory_order_release);
+}
+
+static void TimerCountTask(WorkerBase* worker, void* args)
+{
+	TimerProbe* probe = (TimerProbe*)args;
+
+	if (probe->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		probe->fired.store(Now(), std::memory_order_release);
+}
+
+// Adds and cancels 1M timers that are due in 10s to 70s, samples how late 5ms probes fire while they
+// are pending and how long it takes to fire 1M timers spread over 100ms
+static void Timers(WorkerBase* worker)
+{
+	const char* addName = "timers, add with 1M pending";
+	const char* cancelName = "timers, cancel with 1M pending";
+	const char* jitterName = "timers, 5ms timer lateness with 1M pending";
+	const char* fireName = "timers, fire 1M due within 100ms";
+	const U32 pending = 0x100000;
+
+	if (!Selected(addName) && !Selected(cancelName) && !Selected(jitterName) && !Selected(fireName))
+		return;
+
+	std::vector<I64> addSamples, cancelSamples, jitterSamples, fireSamples;
+	std::vector<TimerHandle> timers(pending);
+	TimerProbe probe;
+
+	for (U32 run = 0; run < options.runs; run++)
+	{
+		I64 start = Now();
+
+		for (U32 i = 0; i < pending; i++)
+			timers[i] = worker->SubmitTimer(&TimerProbeTask, &probe, 10000 + (i * 7919) % 60000, 0);
+
+		addSamples.push_back(Now() - start);
+
+		// one probe at a time so each one sees the idle workers park with the full wheel
+		if (run == 0 && Selected(jitterName))
+		{
+			for (U32 i = 0; i < 0x100; i++)
+			{
+				probe.fired.store(0, std::memory_order_relaxed);
+
+				I64 due = Now() + 5000000;
+				(void)worker->SubmitTimer(&TimerProbeTask, &probe, 5, 0);
+
+				while (probe.fired.load(std::memory_order_acquire) == 0)
+					std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+				jitterSamples.push_back(probe.fired.load(std::memory_order_relaxed) - due);
+			}
+		}
+
+		start = Now();
+
+		for (U32 i = 0; i < pending; i++)
+			(void)worker->CancelTimer(timers[i]);
+
+		cancelSamples.push_back(Now() - start);
+	}
+
+	// firing creates and runs a task per timer, a few runs are plenty
+	for (U32 run = 0; run < options.runs && run < 4 && Selected(fireName); run++)
+	{
+		probe.fired.store(0, std::memory_order_relaxed);
+		probe.remaining.store(pending, std::memory_order_relaxed);
+
+		I64 start = Now();
+
+		for (U32 i = 0; i < pending; i++)
+			(void)worker->SubmitTimer(&TimerCountTask, &probe, 1 + i % 100, 0);
+
+		while (probe.fired.load(std::memory_order_acquire) == 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		fireSamples.push_back(probe.fired.load(std::memory_order_relaxed) - start);
+	}
+
+	if (Selected(addName))
+		Report(addName, pending, addSamples);
+
+	if (Selected(cancelName))
+		Report(cancelName, pending, cancelSamples);
+
+	if (!jitterSamples.empty())
+		Report(jitterName, 1, jitterSamples);
+
+	if (!fireSamples.empty())
+		Report(fireName, pending, fireSamples);
+}
+
+// Queues
+
+static void QueuePush(LockFreeTaskNodeQueue& queue, U32 index)
+{
+	(void)queue.push(index);
+}
+
+static void QueuePush(LockFreeRingTaskNodeQueue& queue, U32 index)
+{
+	while (!queue.push(index))
+		std::this_thread::yield();
+}
+
+// Producers push disjoint ranges of node indices, consumers pop until every index went through
+template<class Queue>
+static I64 QueueRun(Queue& queue, U32 producers, U32 consumers, U32 items)
+{
+	std::atomic<U32> go(0), popped(0);
+	std::vector<std::thread> threads;
+
+	for (U32 i = 0; i < producers; i++)
+	{
+		threads.push_back(std::thread([&queue, &go, i, producers, items]()
+		{
+			while (go.load(std::memory_order_acquire) == 0);
+
+			for (U32 j = items * i / producers; j < items * (i + 1) / producers; j++)
+				QueuePush(queue, j);
+		}));
+	}
+
+	for (U32 i = 0; i < consumers; i++)
+	{
+		threads.push_back(std::thread([&queue, &go, &popped, items]()
+		{
+			while (go.load(std::memory_order_acquire) == 0);
+
+			while (popped.load(std::memory_order_relaxed) != items)
+			{
+				if (queue.tryPop() != UINT32_MAX)
+					popped.fetch_add(1, std::memory_order_relaxed);
+				else
+					std::this_thread::yield();
+			}
+		}));
+	}
+
+	I64 start = Now();
+	go.store(1, std::memory_order_release);
+
+	for (U32 i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	return Now() - start;
+}
+
+// The linked list queue behind the node allocator against the ring under 1..4 producers and consumers
+static void Queues()
+{
+	const char* linkedNames[] = {
+		"queue, linked list, 1 producer 1 consumer",
+		"queue, linked list, 2 producers 2 consumers",
+		"queue, linked list, 4 producers 4 consumers" };
+	const char* ringNames[] = {
+		"queue, ring, 1 producer 1 consumer",
+		"queue, ring, 2 producers 2 consumers",
+		"queue, ring, 4 producers 4 consumers" };
+	const U32 items = 0x10000;
+
+	std::vector<LockFreeTaskNode> taskNodes(items);
+
+	for (U32 i = 0, threads = 1; i < 3; i++, threads <<= 1)
+	{
+		if (Selected(linkedNames[i]))
+		{
+			std::vector<I64> samples;
+			LockFreeTaskNodeQueue queue(taskNodes.data());
+
+			for (U32 j = 0; j < options.runs; j++)
+				samples.push_back(QueueRun(queue, threads, threads, items));
+
+			Report(linkedNames[i], items, samples);
+		}
+
+		if (Selected(ringNames[i]))
+		{
+			std::vector<I64> samples;
+			LockFreeRingTaskNodeQueue queue(0x400);
+
+			for (U32 j = 0; j < options.runs; j++)
+				samples.push_back(QueueRun(queue, threads, threads, items));
+
+			Report(ringNames[i], items, samples);
+		}
+	}
+}
+
+int main(int argc, char** args)
+{
+	options.json = 0;
+	options.pin = 0;
+	options.filter = (const char*)nullptr;
+	options.runs = 0x20;
+
+	for (I32 i = 1; i < argc; i++)
+	{
+		if (strcmp(args[i], "--json") == 0)
+			options.json = 1;
+		else if (strcmp(args[i], "--pin") == 0)
+			options.pin = 1;
+		else if (strcmp(args[i], "--filter") == 0 && i + 1 < argc)
+			options.filter = args[++i];
+		else if (strcmp(args[i], "--runs") == 0 && i + 1 < argc)
+			options.runs = (U32)atoi(args[++i]);
+		else
+		{
+			std::cerr << "Usage: " << args[0] << " [--json] [--pin] [--filter <substring>] [--runs <count>]\n";
+			return 1;
+		}
+	}
+
+	if (options.runs == 0)
+		options.runs = 1;
+
+	HelperTaskSystemConfig config;
+	U32 cpuCount = std::thread::hardware_concurrency();
+	std::vector<CpuMask> affinity;
+
+	// the main thread stays unpinned, helper i runs on cpu i - 1
+	if (options.pin)
+	{
+		config.workerCount = cpuCount + 1;
+		affinity.resize(config.workerCount);
+
+		for (U32 i = 1; i < config.workerCount; i++)
+			affinity[i].Set(i - 1);
+
+		config.affinity = affinity.data();
+	}
+
+	WorkerBase* worker;
+	HelperTaskSystem taskSystem(config, &worker);
+
+	EmptyTasks(worker);
+	Fib(worker);
+	ParallelForArray(worker);
+	DependencyChain(worker);
+	FanIn(worker);
+	DeepTrees(worker);
+	StealFanOut(worker);
+	Scaling();
+	ScratchAllocation(worker);
+	MixedPriorities(worker, taskSystem.workerCount, "priorities, normal probe under normal load",
+		TaskPriority::TPNormal, TaskPriority::TPNormal);
+	MixedPriorities(worker, taskSystem.workerCount, "priorities, high probe under background load",
+		TaskPriority::TPBackground, TaskPriority::TPHigh);
+	WakeLatency(worker, config.spinNanoseconds);
+	BurstRampUp(worker, taskSystem.workerCount, config.spinNanoseconds);
+	IdleCpu(worker);
+	BlockedWaiter(worker);
+	Timers(worker);
+	Queues();
+
+	if (options.json)
+		PrintJson();
+}
@@ -0,0 +1,43 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+#pragma once
+
+#include "Core.hpp"
+
+// Shared by the tasks of one request. Once Cancel was called, tasks holding the token finish
+// without running and running ones see it through WorkerBase::IsCanceled. The token has to outlive
+// every task it is attached to.
+class CancellationToken
+{
+public:
+
+	std::atomic<U32> canceled;
+
+	CancellationToken() : canceled(0) {}
+
+	void Cancel() { canceled.store(1, std::memory_order_relaxed); }
+	Bool IsCanceled() const { return canceled.load(std::memory_order_relaxed) != 0; }
+};
@@ -0,0 +1,235 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+#include "ChaseLevTaskNodeDeque.hpp"
+
+ChaseLevTaskNodeDeque::ChaseLevTaskNodeDeque(U32 capacity)
+	: array((ChaseLevTaskNodeArray*)nullptr),
+	top(0),
+	pad0(),
+	bottom(0),
+	pad1()
+{
+	Initialize(capacity);
+}
+
+ChaseLevTaskNodeDeque::~ChaseLevTaskNodeDeque()
+{
+	Destroy();
+}
+
+void ChaseLevTaskNodeDeque::Initialize(U32 capacity)
+{
+	if (capacity == 0)
+		return;
+
+	top.store(0, std::memory_order_relaxed);
+	bottom.store(0, std::memory_order_relaxed);
+	(void)Grow(0, 0, capacity);
+}
+
+void ChaseLevTaskNodeDeque::Destroy()
+{
+	ChaseLevTaskNodeArray* current = array.load(std::memory_order_relaxed);
+
+	while (current != nullptr)
+	{
+		ChaseLevTaskNodeArray* retired = current->retired;
+		delete[] current->slots;
+		delete current;
+		current = retired;
+	}
+
+	array.store((ChaseLevTaskNodeArray*)nullptr, std::memory_order_relaxed);
+}
+
+ChaseLevTaskNodeArray* ChaseLevTaskNodeDeque::Grow(I64 t, I64 b, U64 capacity)
+{
+	ChaseLevTaskNodeArray* old = array.load(std::memory_order_relaxed);
+	U64 size = old != nullptr ? (old->mask + 1) * 2 : 1;
+
+	while (size < capacity)
+		size <<= 1;
+
+	ChaseLevTaskNodeArray* grown = new ChaseLevTaskNodeArray();
+	grown->slots = new std::atomic<U32>[size];
+	grown->mask = size - 1;
+	grown->retired = old;
+
+	for (I64 i = t; i < b; i++)
+	{
+		U32 index = old->slots[i & old->mask].load(std::memory_order_relaxed);
+		grown->slots[i & grown->mask].store(index, std::memory_order_relaxed);
+	}
+
+	// thieves load the array after bottom, the release store of bottom that follows publishes it
+	array.store(grown, std::memory_order_release);
+	return grown;
+}
+
+Bool ChaseLevTaskNodeDeque::push(U32 index)
+{
+	I64 b = bottom.load(std::memory_order_relaxed);
+	I64 t = top.load(std::memory_order_acquire);
+	ChaseLevTaskNodeArray* current = array.load(std::memory_order_relaxed);
+	Bool grew = 0;
+
+	if (b - t > (I64)current->mask)
+	{
+		current = Grow(t, b, (U64)(b - t) + 1);
+		grew = 1;
+	}
+
+	current->slots[b & current->mask].store(index, std::memory_order_relaxed);
+	bottom.store(b + 1, std::memory_order_release);
+	return grew;
+}
+
+Bool ChaseLevTaskNodeDeque::push(const TaskHandle* tasks, U32 count)
+{
+	I64 b = bottom.load(std::memory_order_relaxed);
+	I64 t = top.load(std::memory_order_acquire);
+	ChaseLevTaskNodeArray* current = array.load(std::memory_order_relaxed);
+	Bool grew = 0;
+
+	if (b - t + (I64)count > (I64)current->mask + 1)
+	{
+		current = Grow(t, b, (U64)(b - t) + count);
+		grew = 1;
+	}
+
+	for (U32 i = 0; i < count; i++)
+		current->slots[(b + i) & current->mask].store(tasks[i].index, std::memory_order_relaxed);
+
+	bottom.store(b + count, std::memory_order_release);
+	return grew;
+}
+
+Bool ChaseLevTaskNodeDeque::push(const U32* indices, U32 count)
+{
+	I64 b = bottom.load(std::memory_order_relaxed);
+	I64 t = top.load(std::memory_order_acquire);
+	ChaseLevTaskNodeArray* current = array.load(std::memory_order_relaxed);
+	Bool grew = 0;
+
+	if (b - t + (I64)count > (I64)current->mask + 1)
+	{
+		current = Grow(t, b, (U64)(b - t) + count);
+		grew = 1;
+	}
+
+	for (U32 i = 0; i < count; i++)
+		current->slots[(b + i) & current->mask].store(indices[i], std::memory_order_relaxed);
+
+	bottom.store(b + count, std::memory_order_release);
+	return grew;
+}
+
+U32 ChaseLevTaskNodeDeque::pop()
+{
+	I64 b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	I64 t = top.load(std::memory_order_relaxed);
+
+	if (t > b)
+	{
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return UINT32_MAX;
+	}
+
+	ChaseLevTaskNodeArray* current = array.load(std::memory_order_relaxed);
+	U32 index = current->slots[b & current->mask].load(std::memory_order_relaxed);
+
+	if (t == b)
+	{
+		// last element, race against thieves for it
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			index = UINT32_MAX;
+
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	return index;
+}
+
+U32 ChaseLevTaskNodeDeque::steal()
+{
+	I64 t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	I64 b = bottom.load(std::memory_order_acquire);
+
+	if (t >= b)
+		return UINT32_MAX;
+
+	ChaseLevTaskNodeArray* current = array.load(std::memory_order_acquire);
+	U32 index = current->slots[t & current->mask].load(std::memory_order_relaxed);
+
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return UINT32_MAX;
+
+	return index;
+}
+
+U32 ChaseLevTaskNodeDeque::steal(U32* indices, U32 count)
+{
+	U32 stolen = 0;
+
+	// the owner takes from the bottom without a CAS while more than one task is left, so every
+	// task still needs its own CAS on top, the batch only saves the thief from coming back
+	while (stolen < count)
+	{
+		I64 t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		I64 b = bottom.load(std::memory_order_acquire);
+
+		if (t >= b)
+			break;
+
+		if (stolen == 0 && (I64)count > (b - t + 1) / 2)
+			count = (U32)((b - t + 1) / 2);
+
+		ChaseLevTaskNodeArray* current = array.load(std::memory_order_acquire);
+		U32 index = current->slots[t & current->mask].load(std::memory_order_relaxed);
+
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			break;
+
+		indices[stolen++] = index;
+	}
+
+	return stolen;
+}
+
+Bool ChaseLevTaskNodeDeque::IsEmpty()
+{
+	return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+}
+
+U32 ChaseLevTaskNodeDeque::Size()
+{
+	I64 size = bottom.load(std::memory_order_relaxed) - top.load(std::memory_order_relaxed);
+	return size > 0 ? (U32)size : 0;
+}
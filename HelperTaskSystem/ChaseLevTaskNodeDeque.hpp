@@ -0,0 +1,80 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+#pragma once
+
+#include "TaskData.hpp"
+
+// Slots of a deque. A full deque moves its tasks into an array of twice the size, the old one stays
+// alive in the retired list until the deque is destroyed because thieves may still read from it.
+struct ChaseLevTaskNodeArray
+{
+	std::atomic<U32>* slots;
+	U64 mask;
+	ChaseLevTaskNodeArray* retired;
+};
+
+// Growing Chase-Lev work stealing deque of task node indices. Only the owning worker may push and
+// pop (LIFO at the bottom), any other thread may steal (FIFO at the top).
+class CACHE_ALIGN ChaseLevTaskNodeDeque
+{
+public:
+
+	std::atomic<ChaseLevTaskNodeArray*> array;
+	std::atomic<I64> top;
+	Byte pad0[CACHE_LINE - sizeof(std::atomic<ChaseLevTaskNodeArray*>) - sizeof(std::atomic<I64>)];
+	std::atomic<I64> bottom;
+	Byte pad1[CACHE_LINE - sizeof(std::atomic<I64>)];
+
+	// capacity is rounded up to a power of two, it only sets the initial size
+	ChaseLevTaskNodeDeque(U32 capacity = 0);
+	~ChaseLevTaskNodeDeque();
+
+	void Initialize(U32 capacity);
+	void Destroy();
+
+	// owner only, return 1 if the deque had to grow
+	Bool push(U32 index);
+
+	// owner only, publishes all tasks with a single store, return 1 if the deque had to grow
+	Bool push(const TaskHandle* tasks, U32 count);
+	Bool push(const U32* indices, U32 count);
+
+	// owner only
+	U32 pop();
+
+	// any thread, return UINT32_MAX if empty or if another thread won the race
+	U32 steal();
+
+	// any thread, steal the oldest half of the tasks but at most count into indices, stop at the
+	// first lost race and return how many were stolen
+	U32 steal(U32* indices, U32 count);
+
+	Bool IsEmpty();
+	U32 Size();
+
+	// owner only, move the tasks from t to b into an array with room for at least capacity
+	ChaseLevTaskNodeArray* Grow(I64 t, I64 b, U64 capacity);
+};
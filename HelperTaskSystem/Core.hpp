@@ -39,23 +39,21 @@ typedef std::chrono::high_resolution_clock::time_point TimePoint;
 #define test_loop(count)				\
 I64 _avg__ = 0;							\
 I64 _max__ = 0;							\
+I64 _sum__ = 0;							\
 for (U32 _i_ = 0; _i_ < count; _i_++)
 
 #define test_loop_begin_test TimePoint _start__ = Clock::now()
 
+// _avg__ is the mean and _max__ the slowest of all runs so far
+#define test_loop_add_sample(time)					            \
+_sum__ += (time);									            \
+_avg__ = _sum__ / (I64)(_i_ + 1);					            \
+_max__ = _max__ < (time) ? (time) : _max__
+
 #define test_loop_end_test						            \
 TimePoint _end__ = Clock::now();					        \
-												            \
-if (_i_ == 0)									            \
-{           									            \
-    _avg__ = (_end__ - _start__).count();			        \
-    _max__ = _avg__;				                        \
-}           				                                \
-else											            \
-{   											            \
-    _avg__ = (_avg__ + (_end__ - _start__).count()) / 2;    \
-    _max__ = _max__ < _avg__ ? _avg__ : _max__;             \
-} do {} while(false)
+I64 _time__ = (_end__ - _start__).count();			        \
+test_loop_add_sample(_time__)
 
 #define test_loop_print_result(name) std::cout << name << " - Average Time: " << _avg__ << ", Max Time:" << _max__ << "\n"
 
@@ -0,0 +1,352 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+#pragma once
+
+#include "WorkerBase.hpp"
+#include "SmallBlockCache.hpp"
+
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+
+/**
+* AsyncTask<T>
+* 
+* A coroutine returning AsyncTask<T> starts suspended. Spawn creates a task node that finishes
+* together with the coroutine and queues the first step, the returned handle works like any other
+* task handle for WaitOnTask, AddDependency or co_await. The AsyncTask object owns the coroutine
+* frame, keep it alive until that task finished and read the value with Result.
+* 
+* co_await TaskHandle suspends the coroutine and queues a resume task depending on the awaited
+* task, so no worker blocks while the coroutine waits. Every step may run on a different worker,
+* co_await CurrentWorker() returns the one running the current step, fetch it again after every
+* co_await. A task created with function
+* nullptr and submitted later works as an event, e.g. for the completion of an I/O request.
+* 
+* Every step runs with the priority of the task that spawned the coroutine, the completion task
+* also takes its CancellationToken. A coroutine awaited by another one takes both from that one.
+* 
+* An exception escaping the coroutine is kept in the promise and its task finishes as TRFailed.
+* Result and co_await on the AsyncTask throw it again, co_await on its TaskHandle does not.
+*/
+
+// Child of the completion task of a coroutine that threw, fails it through ExecuteTask.
+inline void AsyncRethrowTask(WorkerBase*, void* args)
+{
+	std::rethrow_exception(*(std::exception_ptr*)args);
+}
+
+struct AsyncPromiseBase
+{
+	WorkerBase* worker;
+	TaskHandle task;
+	std::coroutine_handle<> self;
+	std::exception_ptr exception;
+
+	AsyncPromiseBase() : worker((WorkerBase*)nullptr), task(), self(), exception() {}
+
+	// frames come from the small block cache of the thread creating the coroutine
+	static void* operator new(std::size_t size) { return AllocateSmallBlock(size); }
+	static void operator delete(void* frame, std::size_t size) { FreeSmallBlock(frame, size); }
+
+	std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+
+	// Submitting the completion task is the last thing touching the frame, the owner may destroy
+	// it as soon as the task finished.
+	struct FinalAwaiter
+	{
+		bool await_ready() noexcept { return false; }
+
+		template <class Promise>
+		void await_suspend(std::coroutine_handle<Promise> coroutine) noexcept
+		{
+			AsyncPromiseBase& promise = coroutine.promise();
+			WorkerBase* worker = promise.worker;
+			TaskHandle task = promise.task;
+
+			// the child holds the completion task back, the frame stays alive until it threw
+			if (promise.exception)
+				worker->SubmitTask(worker->NewTask(&AsyncRethrowTask, &promise.exception, TaskHandle(), task));
+
+			worker->SubmitTask(task);
+		}
+
+		void await_resume() noexcept {}
+	};
+
+	FinalAwaiter final_suspend() noexcept { return FinalAwaiter(); }
+
+	void unhandled_exception() { exception = std::current_exception(); }
+};
+
+// Runs the next step of a suspended coroutine on the worker that picked up the task.
+inline void AsyncResumeTask(WorkerBase* worker, void* args)
+{
+	AsyncPromiseBase* promise = (AsyncPromiseBase*)args;
+	promise->worker = worker;
+	promise->self.resume();
+}
+
+// Queue the next step of the coroutine once dependency finished, the coroutine may already run on
+// another worker when this returns.
+inline void AsyncResumeAfter(AsyncPromiseBase& promise, TaskHandle dependency)
+{
+	WorkerBase* worker = promise.worker;
+	TaskHandle resume = worker->NewTask(&AsyncResumeTask, &promise, dependency, TaskHandle());
+	worker->SetPriority(resume, worker->GetPriority(promise.task));
+	worker->SubmitTask(resume);
+}
+
+// The completion task takes the priority and token of spawner, the running task or the completion
+// task of the coroutine awaiting this one. Only the priority reaches the resume tasks, one skipped
+// for a canceled token would leave the coroutine suspended and its completion task unfinished.
+inline TaskHandle AsyncSpawn(AsyncPromiseBase& promise, std::coroutine_handle<> self, WorkerBase* worker,
+	TaskHandle spawner)
+{
+	promise.worker = worker;
+	promise.self = self;
+	promise.task = worker->NewTask((TaskFunction)nullptr, nullptr, TaskHandle(), TaskHandle());
+
+	if (spawner.index != UINT32_MAX)
+	{
+		worker->SetPriority(promise.task, worker->GetPriority(spawner));
+		worker->SetCancellationToken(promise.task, worker->GetCancellationToken(spawner));
+	}
+
+	TaskHandle task = promise.task;
+	AsyncResumeAfter(promise, TaskHandle());
+	return task;
+}
+
+template <class T>
+class AsyncTask;
+
+template <class T>
+struct AsyncPromise : AsyncPromiseBase
+{
+	alignas(T) Byte value[sizeof(T)];
+	Bool hasValue;
+
+	AsyncPromise() : AsyncPromiseBase(), value(), hasValue(0) {}
+
+	~AsyncPromise()
+	{
+		if (hasValue)
+			((T*)value)->~T();
+	}
+
+	AsyncTask<T> get_return_object();
+
+	template <class U>
+	void return_value(U&& result)
+	{
+		new (value) T(static_cast<U&&>(result));
+		hasValue = 1;
+	}
+};
+
+template <>
+struct AsyncPromise<void> : AsyncPromiseBase
+{
+	AsyncTask<void> get_return_object();
+
+	void return_void() {}
+};
+
+template <class T>
+class AsyncTask
+{
+public:
+
+	typedef AsyncPromise<T> promise_type;
+
+	std::coroutine_handle<promise_type> coroutine;
+
+	AsyncTask() : coroutine() {}
+	explicit AsyncTask(std::coroutine_handle<promise_type> coroutine) : coroutine(coroutine) {}
+	AsyncTask(AsyncTask&& other) noexcept : coroutine(other.coroutine) { other.coroutine = nullptr; }
+	AsyncTask(const AsyncTask&) = delete;
+	AsyncTask& operator=(const AsyncTask&) = delete;
+
+	~AsyncTask()
+	{
+		if (coroutine)
+			coroutine.destroy();
+	}
+
+	// Queue the first step on worker, return the task that finishes with the coroutine.
+	TaskHandle Spawn(WorkerBase* worker)
+	{
+		return AsyncSpawn(coroutine.promise(), coroutine, worker, worker->CurrentTask());
+	}
+
+	// Only valid after the task returned by Spawn finished, throws the exception of a failed
+	// coroutine.
+	T& Result()
+	{
+		if (coroutine.promise().exception)
+			std::rethrow_exception(coroutine.promise().exception);
+
+		return *(T*)coroutine.promise().value;
+	}
+};
+
+template <>
+class AsyncTask<void>
+{
+public:
+
+	typedef AsyncPromise<void> promise_type;
+
+	std::coroutine_handle<promise_type> coroutine;
+
+	AsyncTask() : coroutine() {}
+	explicit AsyncTask(std::coroutine_handle<promise_type> coroutine) : coroutine(coroutine) {}
+	AsyncTask(AsyncTask&& other) noexcept : coroutine(other.coroutine) { other.coroutine = nullptr; }
+	AsyncTask(const AsyncTask&) = delete;
+	AsyncTask& operator=(const AsyncTask&) = delete;
+
+	~AsyncTask()
+	{
+		if (coroutine)
+			coroutine.destroy();
+	}
+
+	TaskHandle Spawn(WorkerBase* worker)
+	{
+		return AsyncSpawn(coroutine.promise(), coroutine, worker, worker->CurrentTask());
+	}
+
+	void Result()
+	{
+		if (coroutine.promise().exception)
+			std::rethrow_exception(coroutine.promise().exception);
+	}
+};
+
+template <class T>
+inline AsyncTask<T> AsyncPromise<T>::get_return_object()
+{
+	return AsyncTask<T>(std::coroutine_handle<AsyncPromise<T>>::from_promise(*this));
+}
+
+inline AsyncTask<void> AsyncPromise<void>::get_return_object()
+{
+	return AsyncTask<void>(std::coroutine_handle<AsyncPromise<void>>::from_promise(*this));
+}
+
+struct TaskHandleAwaiter
+{
+	TaskHandle task;
+
+	bool await_ready() noexcept { return false; }
+
+	template <class Promise>
+	void await_suspend(std::coroutine_handle<Promise> coroutine)
+	{
+		AsyncResumeAfter(coroutine.promise(), task);
+	}
+
+	void await_resume() noexcept {}
+};
+
+inline TaskHandleAwaiter operator co_await(TaskHandle task)
+{
+	return TaskHandleAwaiter{task};
+}
+
+// co_await on a child coroutine spawns it and resumes with its result once it finished.
+template <class T>
+struct AsyncTaskAwaiter
+{
+	AsyncTask<T>& child;
+
+	bool await_ready() noexcept { return false; }
+
+	template <class Promise>
+	void await_suspend(std::coroutine_handle<Promise> coroutine)
+	{
+		AsyncPromiseBase& promise = coroutine.promise();
+		TaskHandle task = AsyncSpawn(child.coroutine.promise(), child.coroutine, promise.worker,
+			promise.task);
+		AsyncResumeAfter(promise, task);
+	}
+
+	T await_resume() { return static_cast<T&&>(child.Result()); }
+};
+
+template <>
+struct AsyncTaskAwaiter<void>
+{
+	AsyncTask<void>& child;
+
+	bool await_ready() noexcept { return false; }
+
+	template <class Promise>
+	void await_suspend(std::coroutine_handle<Promise> coroutine)
+	{
+		AsyncPromiseBase& promise = coroutine.promise();
+		TaskHandle task = AsyncSpawn(child.coroutine.promise(), child.coroutine, promise.worker,
+			promise.task);
+		AsyncResumeAfter(promise, task);
+	}
+
+	void await_resume() { child.Result(); }
+};
+
+template <class T>
+inline AsyncTaskAwaiter<T> operator co_await(AsyncTask<T>& child)
+{
+	return AsyncTaskAwaiter<T>{child};
+}
+
+template <class T>
+inline AsyncTaskAwaiter<T> operator co_await(AsyncTask<T>&& child)
+{
+	return AsyncTaskAwaiter<T>{child};
+}
+
+// co_await CurrentWorker() returns the worker running the current step without suspending.
+struct CurrentWorker
+{
+	WorkerBase* worker;
+
+	CurrentWorker() : worker((WorkerBase*)nullptr) {}
+
+	bool await_ready() noexcept { return false; }
+
+	template <class Promise>
+	bool await_suspend(std::coroutine_handle<Promise> coroutine) noexcept
+	{
+		worker = coroutine.promise().worker;
+		return false;
+	}
+
+	WorkerBase* await_resume() noexcept { return worker; }
+};
+
+#endif
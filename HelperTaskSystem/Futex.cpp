@@ -23,22 +23,59 @@
 **************************************************************************************************/
 
 #include "Futex.hpp"
+
+#if SYSTEM_WINDOWS
+
 #include <Windows.h>
 
 #pragma comment(lib, "Synchronization")
 
+#elif SYSTEM_LINUX || SYSTEM_ANDROID
+
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#else
+
+#error Futex is not implemented for this system
+
+#endif
+
 Futex::Futex(I32 val)
 	: val(val)
 {
 
 }
 
-void Futex::Wait(I32 comparand, U32 timeoutMilliseconds)
+#if SYSTEM_WINDOWS
+
+Bool Futex::Wait(I32 comparand, U32 timeoutMilliseconds)
 {
-	do
+	if (timeoutMilliseconds == UINT32_MAX)
+	{
+		do
+		{
+			WaitOnAddress(&val, &comparand, sizeof(I32), INFINITE);
+		} while (val.load(std::memory_order_acquire) == comparand);
+
+		return 1;
+	}
+
+	ULONGLONG deadline = GetTickCount64() + timeoutMilliseconds;
+
+	while (val.load(std::memory_order_acquire) == comparand)
 	{
-		WaitOnAddress(&val, &comparand, sizeof(I32), (DWORD)timeoutMilliseconds);
-	} while (val.load(std::memory_order_acquire) == comparand);
+		ULONGLONG now = GetTickCount64();
+
+		if (now >= deadline)
+			return 0;
+
+		WaitOnAddress(&val, &comparand, sizeof(I32), (DWORD)(deadline - now));
+	}
+
+	return 1;
 }
 
 void Futex::WakeSingle()
@@ -50,3 +87,62 @@ void Futex::WakeAll()
 {
 	WakeByAddressAll(&val);
 }
+
+#else
+
+static_assert(sizeof(std::atomic<I32>) == sizeof(int), "futex word must be a plain 32 bit integer");
+
+static I64 MonotonicNanoseconds()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (I64)now.tv_sec * 1000000000 + (I64)now.tv_nsec;
+}
+
+// The private variants skip the shared futex hash lookup, all waiters live in this process.
+static long FutexCall(std::atomic<I32>* address, int operation, I32 value, const timespec* timeout)
+{
+	return syscall(SYS_futex, (int*)address, operation, value, timeout, (int*)nullptr, 0);
+}
+
+Bool Futex::Wait(I32 comparand, U32 timeoutMilliseconds)
+{
+	if (timeoutMilliseconds == UINT32_MAX)
+	{
+		while (val.load(std::memory_order_acquire) == comparand)
+			(void)FutexCall(&val, FUTEX_WAIT_PRIVATE, comparand, (const timespec*)nullptr);
+
+		return 1;
+	}
+
+	// FUTEX_WAIT takes a relative timeout, recompute it after spurious or EINTR wakeups
+	I64 deadline = MonotonicNanoseconds() + (I64)timeoutMilliseconds * 1000000;
+
+	while (val.load(std::memory_order_acquire) == comparand)
+	{
+		I64 remaining = deadline - MonotonicNanoseconds();
+
+		if (remaining <= 0)
+			return 0;
+
+		timespec timeout;
+		timeout.tv_sec = (time_t)(remaining / 1000000000);
+		timeout.tv_nsec = (long)(remaining % 1000000000);
+
+		(void)FutexCall(&val, FUTEX_WAIT_PRIVATE, comparand, &timeout);
+	}
+
+	return 1;
+}
+
+void Futex::WakeSingle()
+{
+	(void)FutexCall(&val, FUTEX_WAKE_PRIVATE, 1, (const timespec*)nullptr);
+}
+
+void Futex::WakeAll()
+{
+	(void)FutexCall(&val, FUTEX_WAKE_PRIVATE, I32_MAX, (const timespec*)nullptr);
+}
+
+#endif
@@ -34,7 +34,9 @@ public:
 
 	Futex(I32 val = 0);
 
-	void Wait(I32 comparand, U32 timeoutMilliseconds);
+	// Blocks while val == comparand. Pass UINT32_MAX to wait without timeout.
+	// Returns 0 if the timeout expired before val changed.
+	Bool Wait(I32 comparand, U32 timeoutMilliseconds);
 	void WakeSingle();
 	void WakeAll();
 };
\ No newline at end of file
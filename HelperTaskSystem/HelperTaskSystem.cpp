@@ -24,35 +24,120 @@
 
 #include "HelperTaskSystem.hpp"
 
+TaskSystemHelper::TaskSystemHelper()
+	: sleepingMask((std::atomic<U64>*)nullptr),
+	pad0(),
+	sleeping(0),
+	idle(0),
+	spinning(0),
+	pad1(),
+	highCount(0),
+	pad2(),
+	failing(0),
+	pad3()
+{
+}
+
 HelperTaskSystem::HelperTaskSystem(WorkerBase** _mainThreadWorker)
 	: nodeAllocator(),
 	helper(),
+	timers(),
+	workers((HelperTaskSystemWorker*)nullptr),
+	workerCount(0),
+	externalSubmitterCount(0),
+	spinNanoseconds(0),
+	maxSpinningWorkers(0),
+	threads()
+{
+	Initialize(HelperTaskSystemConfig(), _mainThreadWorker);
+}
+
+HelperTaskSystem::HelperTaskSystem(const HelperTaskSystemConfig& config, WorkerBase** _mainThreadWorker)
+	: nodeAllocator(),
+	helper(),
+	timers(),
 	workers((HelperTaskSystemWorker*)nullptr),
 	workerCount(0),
+	externalSubmitterCount(0),
+	spinNanoseconds(0),
+	maxSpinningWorkers(0),
 	threads()
 {
-	U32 threadCount = std::thread::hardware_concurrency();
+	Initialize(config, _mainThreadWorker);
+}
+
+void HelperTaskSystem::Initialize(const HelperTaskSystemConfig& config, WorkerBase** _mainThreadWorker)
+{
+	U32 threadCount = config.workerCount;
 
-	if (threadCount < 4)
-		threadCount = 4;
+	if (threadCount == 0)
+	{
+		threadCount = std::thread::hardware_concurrency();
+
+		if (threadCount < 4)
+			threadCount = 4;
+	}
 
 	workerCount = threadCount;
+	externalSubmitterCount = config.externalSubmitterCount;
+	spinNanoseconds = config.spinNanoseconds;
+	maxSpinningWorkers = config.maxSpinningWorkers != 0 ? config.maxSpinningWorkers : (workerCount + 1) / 2;
 
 	// task nodes
-	nodeAllocator.Initialize(workerCount * 3, 0x400);
-	helper.index = 0;
-	helper.queue.taskNodes = nodeAllocator.freeTaskNodeList.taskNodes;
-	helper.state.val.store(1, std::memory_order_relaxed);
+	U32 blockCount = config.initialBlockCount != 0 ? config.initialBlockCount : workerCount * 3;
 
-	// workers
-	workers = (HelperTaskSystemWorker*)malloc(sizeof(HelperTaskSystemWorker) * threadCount);
+	nodeAllocator.Initialize(blockCount, config.blockSize, config.maxTaskNodeCount);
 
-	for (U32 i = 0; i < workerCount; i++)
+	// one bit per worker, external submitters park like workers inside RunUntil
+	U32 slotCount = workerCount + externalSubmitterCount;
+	U32 maskWords = (slotCount + 63) / 64;
+	helper.sleepingMask = (std::atomic<U64>*)AllocateAlignedBytes(sizeof(std::atomic<U64>) * maskWords, CACHE_LINE);
+
+	for (U32 i = 0; i < maskWords; i++)
+		new (helper.sleepingMask + i) std::atomic<U64>(0);
+
+	// workers followed by the external submitter slots
+	workers = (HelperTaskSystemWorker*)AllocateAlignedBytes(sizeof(HelperTaskSystemWorker) * slotCount,
+		alignof(HelperTaskSystemWorker));
+
+	for (U32 i = 0; i < slotCount; i++)
 	{
 		U32 first = nodeAllocator.TryPop();
-		new (workers + i) HelperTaskSystemWorker(this, first, i);
+		HelperTaskSystemWorker* worker = new (workers + i) HelperTaskSystemWorker(this, first, i);
+
+		if (config.affinity != nullptr && i < workerCount)
+			worker->affinity = config.affinity[i];
+
+		if (config.numaNodes != nullptr && i < workerCount)
+			worker->numaNode = config.numaNodes[i];
+
+#if defined(BUILD_SCHEDULER_TRACE)
+		worker->trace.Initialize(config.traceEventCount);
+#endif
 	}
 
+	// steal order, topology only tells where pinned workers are, external submitters end up in
+	// the remote tier
+	std::vector<CpuLocation> cpus;
+	std::vector<CpuLocation> locations(slotCount);
+
+	if (ReadCpuTopology(cpus))
+	{
+		for (U32 i = 0; i < workerCount; i++)
+			locations[i] = LocateCpuMask(cpus, workers[i].affinity);
+	}
+
+	for (U32 i = 0; i < workerCount; i++)
+	{
+		if (workers[i].numaNode >= 0)
+			locations[i].numaNode = workers[i].numaNode;
+	}
+
+	for (U32 i = 0; i < slotCount; i++)
+		workers[i].BuildStealOrder(locations.data());
+
+	workers[0].Pin();
+
 	// threads
 	for (U32 i = 1; i < workerCount; i++)
 	{
@@ -65,31 +150,129 @@ HelperTaskSystem::HelperTaskSystem(WorkerBase** _mainThreadWorker)
 
 HelperTaskSystem::~HelperTaskSystem()
 {
+	// create all quit tasks before submitting any, NewTask may run queued tasks when the node pool
+	// is exhausted and must not pick up a quit task meant for a helper thread
+	std::vector<TaskHandle> quitTasks(workerCount);
+
 	for (U32 i = 0; i < workerCount; i++)
 	{
-		TaskHandle quitTask = workers[0].NewTask(nullptr, nullptr, TaskHandle(), TaskHandle());
-		nodeAllocator.freeTaskNodeList.taskNodes[quitTask.index].task.flags = TaskFlags::TFQuit;
-		workers[0].SubmitTask(quitTask);
+		quitTasks[i] = workers[0].NewTask(nullptr, nullptr, TaskHandle(), TaskHandle());
+		nodeAllocator.taskNodes[quitTasks[i].index].task.flags = TaskFlags::TFQuit;
 	}
 
+	for (U32 i = 0; i < workerCount; i++)
+		workers[0].SubmitTask(quitTasks[i]);
+
 	for (U32 i = 0; i < threads.size(); i++)
 	{
 		threads[i].join();
 	}
 
-	for (U32 i = 0; i < workerCount; i++)
+	for (U32 i = 0; i < workerCount + externalSubmitterCount; i++)
 		workers[i].~HelperTaskSystemWorker();
-	Free(workers);
+	FreeAligned(workers);
+	FreeAligned(helper.sleepingMask);
+}
+
+WorkerBase* HelperTaskSystem::AcquireExternalSubmitter()
+{
+	for (U32 i = workerCount; i < workerCount + externalSubmitterCount; i++)
+	{
+		U32 tmp = 0;
+
+		// the acquire pairs with the release of the previous owner, its free list and deques are ours now
+		if (workers[i].claimed.load(std::memory_order_relaxed) == 0 &&
+			workers[i].claimed.compare_exchange_strong(tmp, 1, std::memory_order_acquire))
+			return workers + i;
+	}
+
+	return (WorkerBase*)nullptr;
+}
+
+void HelperTaskSystem::ReleaseExternalSubmitter(WorkerBase* submitter)
+{
+	// tasks still queued in the slot are stolen by the workers like before
+	((HelperTaskSystemWorker*)submitter)->claimed.store(0, std::memory_order_release);
+}
+
+void HelperTaskSystem::Wake(WorkerBase* worker)
+{
+	// clearing the bit releases the caller's writes to a worker that is about to park, it reads
+	// them once it sets the bit again
+	HelperTaskSystemWorker* target = (HelperTaskSystemWorker*)worker;
+	target->WakeWorker(target->index);
+}
+
+void HelperTaskSystem::PrintStats(std::ostream& stream)
+{
+#if defined(BUILD_SCHEDULER_STATS)
+	U64 totals[WorkerStats::WSCount] = {};
+
+	for (U32 i = 0; i <= workerCount; i++)
+	{
+		if (i < workerCount)
+			stream << "worker " << i;
+		else
+			stream << "total";
+
+		for (U32 j = 0; j < WorkerStats::WSCount; j++)
+		{
+			U64 value = i < workerCount ? workers[i].stats.Get(j) : totals[j];
+			totals[j] += i < workerCount ? value : 0;
+
+			stream << (j == 0 ? ": " : ", ") << WorkerStats::Name(j) << " " << value;
+		}
+
+		stream << "\n";
+	}
+#else
+	stream << "Scheduler stats are compiled out, define BUILD_SCHEDULER_STATS.\n";
+#endif
+}
+
+Bool HelperTaskSystem::WriteChromeTrace(const char* path)
+{
+#if defined(BUILD_SCHEDULER_TRACE)
+	FILE* file = fopen(path, "w");
+
+	if (file == nullptr)
+		return 0;
+
+	U32 written = 0;
+	fprintf(file, "{\"traceEvents\":[");
+
+	for (U32 i = 0; i < workerCount; i++)
+		written += workers[i].trace.WriteChromeTrace(file, i, written == 0);
+
+	fprintf(file, "\n]}\n");
+	return fclose(file) == 0;
+#else
+	(void)path;
+	return 0;
+#endif
 }
 
 void HelperTaskSystem::WorkerLoop(HelperTaskSystemWorker* worker)
 {
+	worker->Pin();
+
 	while (true)
 	{
 		U32 task = worker->PopWork();
 		
-		if (worker->workList.taskNodes[task].task.flags == TaskFlags::TFQuit)
+		if (worker->taskNodes[task].task.flags == TaskFlags::TFQuit)
+		{
+			// quit tasks stolen along with ours stay behind in our deques, wake a worker for each
+			U32 left = 0;
+
+			for (U32 i = 0; i < TaskPriority::TPCount; i++)
+				left += worker->workLists[i].Size();
+
+			if (left != 0)
+				worker->WakeSleepers(left);
+
 			break;
+		}
 
 		worker->ExecuteTask(task);
 	}
@@ -107,8 +290,44 @@ HelperTaskSystemWorker::HelperTaskSystemWorker(
 	doneListSize(0),
 	blockSize(taskSystem->nodeAllocator.blockSize),
 	index(index),
-	workList(taskSystem->nodeAllocator.freeTaskNodeList.taskNodes)
+	executeCount(0),
+	currentTask(UINT32_MAX),
+	random(index * 0x9E3779B9 + 1),
+	claimed(0),
+	pollingTimers(0),
+	idleEstimate(taskSystem->spinNanoseconds / 2),
+	spinBudget(taskSystem->spinNanoseconds),
+	numaNode(-1),
+	affinity(),
+	taskNodes(taskSystem->nodeAllocator.taskNodes),
+	workLists(),
+	parked(),
+	firedTimers(),
+	victims(),
+	victimTierEnd(),
+	arena()
 {
+	for (U32 i = 0; i < TaskPriority::TPCount; i++)
+		workLists[i].Initialize(0x1000);
+}
+
+void HelperTaskSystemWorker::Pin()
+{
+	if (!affinity.IsEmpty())
+		(void)SetCurrentThreadAffinity(affinity);
+
+	if (numaNode < 0)
+		return;
+
+	if (freeListStart != UINT32_MAX)
+		(void)BindMemoryToNumaNode(taskNodes + freeListStart, blockSize * sizeof(LockFreeTaskNode), (U32)numaNode);
+
+	// arrays the deques grow into later are allocated and first touched on this thread
+	for (U32 i = 0; i < TaskPriority::TPCount; i++)
+	{
+		ChaseLevTaskNodeArray* array = workLists[i].array.load(std::memory_order_relaxed);
+		(void)BindMemoryToNumaNode(array->slots, (UPtr)(array->mask + 1) * sizeof(std::atomic<U32>), (U32)numaNode);
+	}
 }
 
 void HelperTaskSystemWorker::PushDone(U32 index)
@@ -117,7 +336,7 @@ void HelperTaskSystemWorker::PushDone(U32 index)
 	{
 		if (doneListSize != 0)
 		{
-			workList.taskNodes[doneListEnd].task.dependency.index = index;
+			taskNodes[doneListEnd].freeNext = index;
 			doneListEnd = index;
 			doneListSize++;
 			return;
@@ -138,15 +357,54 @@ void HelperTaskSystemWorker::PushDone(U32 index)
 
 void HelperTaskSystemWorker::PushWork(U32 index)
 {
-	if (workList.push(index))
-	{
-		Wake();
-	}
+	TaskSystemHelper& helper = taskSystem->helper;
+	U32 priority = TaskFlags::Priority(taskNodes[index].task.flags);
+
+	if (priority == TaskPriority::TPHigh)
+		helper.highCount.fetch_add(1, std::memory_order_relaxed);
+
+	if (workLists[priority].push(index))
+		WORKER_STAT(this, WSDequeGrowths, 1);
+
+	// a spinning worker picks the task up and wakes the next one once it got more than that
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (helper.spinning.load(std::memory_order_relaxed) == 0)
+		WakeSleepers(1);
 }
 
 U32 HelperTaskSystemWorker::TryPopWork()
 {
-	return workList.tryPop();
+	TaskSystemHelper& helper = taskSystem->helper;
+	U32 task;
+
+	if (executeCount % TaskPriority::BackgroundInterval == 0 &&
+		(task = workLists[TaskPriority::TPBackground].pop()) != UINT32_MAX)
+		return task;
+
+	if ((task = workLists[TaskPriority::TPHigh].pop()) != UINT32_MAX)
+	{
+		helper.highCount.fetch_sub(1, std::memory_order_relaxed);
+		return task;
+	}
+
+	if (helper.highCount.load(std::memory_order_relaxed) != 0 &&
+		(task = StealWork(TaskPriority::TPHigh)) != UINT32_MAX)
+		return task;
+
+	if ((task = workLists[TaskPriority::TPNormal].pop()) != UINT32_MAX)
+		return task;
+
+	ChaseLevTaskNodeDeque& background = workLists[TaskPriority::TPBackground];
+
+	if (background.IsEmpty())
+		return UINT32_MAX;
+
+	// only pay for looking at the other workers when we would run background work otherwise
+	if ((task = StealWork(TaskPriority::TPNormal)) != UINT32_MAX)
+		return task;
+
+	return background.pop();
 }
 
 U32 HelperTaskSystemWorker::PopWork()
@@ -154,10 +412,18 @@ U32 HelperTaskSystemWorker::PopWork()
 	U32 task;
 	while (true)
 	{
+		if (executeCount % TimerWheel::PollInterval == 0)
+			(void)PollTimers();
+
 		if ((task = TryPopWork()) != UINT32_MAX)
 			return task;
 
-		Sleep();
+		taskSystem->helper.idle.fetch_add(1, std::memory_order_relaxed);
+		task = Sleep();
+		taskSystem->helper.idle.fetch_sub(1, std::memory_order_relaxed);
+
+		if (task != UINT32_MAX)
+			return task;
 	}
 }
 
@@ -168,14 +434,24 @@ U32 HelperTaskSystemWorker::TryPopFree()
 	if (freeListStart != UINT32_MAX)
 	{
 		tmp = freeListStart;
-		freeListStart = workList.taskNodes[freeListStart].task.dependency.index;
+		freeListStart = taskNodes[freeListStart].freeNext;
+		return tmp;
+	}
+
+	// reuse the nodes we finished ourselves, they are still in our cache and on our numa node
+	if (doneListSize != 0)
+	{
+		taskNodes[doneListEnd].freeNext = UINT32_MAX;
+		tmp = doneListStart;
+		freeListStart = taskNodes[tmp].freeNext;
+		doneListSize = 0;
 		return tmp;
 	}
 
 	// pop from allocator free list
 	if ((tmp = taskSystem->nodeAllocator.TryPop()) != UINT32_MAX)
 	{
-		freeListStart = workList.taskNodes[tmp].task.dependency.index;
+		freeListStart = taskNodes[tmp].freeNext;
 		return tmp;
 	}
 
@@ -190,174 +466,497 @@ U32 HelperTaskSystemWorker::PopFree()
 		if ((tmp = TryPopFree()) != UINT32_MAX)
 			return tmp;
 
-		if ((tmp = TryPopWork()) != UINT32_MAX)
-		{
-			ExecuteTask(tmp);
+		// commit more nodes before falling back to running tasks until some are recycled
+		if (taskSystem->nodeAllocator.Grow())
 			continue;
+
+		if ((tmp = TryPopWork()) != UINT32_MAX || (tmp = Help()) != UINT32_MAX)
+			ExecuteTask(tmp);
+	}
+}
+
+void HelperTaskSystemWorker::BuildStealOrder(const CpuLocation* locations)
+{
+	U32 slotCount = taskSystem->workerCount + taskSystem->externalSubmitterCount;
+
+	victims.clear();
+
+	for (U32 tier = 0; tier < CpuLocation::DCount; tier++)
+	{
+		for (U32 i = 1; i < slotCount; i++)
+		{
+			U32 victim = (index + i) % slotCount;
+
+#if defined(BUILD_LINEAR_STEAL_ORDER)
+			// everybody in one tier, scanned from our neighbour on like before the topology
+			if (tier == CpuLocation::DRemote)
+#else
+			if (locations[index].DistanceTo(locations[victim]) == tier)
+#endif
+				victims.push_back(victim);
 		}
 
-		(void)Help(false);
+		victimTierEnd[tier] = (U32)victims.size();
 	}
 }
 
-U32 HelperTaskSystemWorker::Help(Bool allowSleep)
+U32 HelperTaskSystemWorker::KeepStolen(const U32* indices, U32 count, U32 priority)
 {
-	if (!taskSystem->helper.lock.try_lock())
-		return 0;
+	WORKER_STAT(this, WSTasksStolen, count);
 
-	TaskSystemHelper& helper = taskSystem->helper;
+	// high priority tasks stay counted until they are popped
+	if (priority == TaskPriority::TPHigh)
+		taskSystem->helper.highCount.fetch_sub(1, std::memory_order_relaxed);
+
+	if (count > 1 && workLists[priority].push(indices + 1, count - 1))
+		WORKER_STAT(this, WSDequeGrowths, 1);
+
+	return indices[0];
+}
+
+U32 HelperTaskSystemWorker::StealWork(U32 priority)
+{
 	HelperTaskSystemWorker* workers = taskSystem->workers;
-	U32 myIndex = index - 1, task, workerCount = taskSystem->workerCount - 1;
+	U32 indices[StealBatch];
+	U32 count, begin = 0;
+
+#if defined(BUILD_LINEAR_STEAL_ORDER)
+	U32 start = 0;
+#else
+	// a random start inside each tier keeps the thieves of a tier from all hitting the same victim
+	random ^= random << 13;
+	random ^= random >> 17;
+	random ^= random << 5;
+	U32 start = random;
+#endif
+
+	for (U32 tier = 0; tier < CpuLocation::DCount; begin = victimTierEnd[tier], tier++)
+	{
+		U32 size = victimTierEnd[tier] - begin;
 
-	if (helper.index == myIndex)
-		helper.index = (helper.index + 1) % workerCount;
+		if (size == 0)
+			continue;
 
+		U32 offset = start % size;
 
-	// Split work from helper queue
+		for (U32 i = 0; i < size; i++)
+		{
+			U32 j = offset + i < size ? offset + i : offset + i - size;
+			ChaseLevTaskNodeDeque& victim = workers[victims[begin + j]].workLists[priority];
 
-	while ((task = helper.queue.tryPop()) != UINT32_MAX)
+			if (victim.IsEmpty())
+				continue;
+
+			WORKER_STAT(this, WSStealsAttempted, 1);
+
+			if ((count = victim.steal(indices, StealBatch)) != 0)
+			{
+				WORKER_STAT(this, WSStealsSucceeded, 1);
+
+				U32 task = KeepStolen(indices, count, priority);
+
+				// there is more here or with the victim, get another worker going once the rest of
+				// the batch is visible in our deque
+				if (count > 1 || !victim.IsEmpty())
+					WakeSleepers(1);
+
+				return task;
+			}
+		}
+	}
+
+	return UINT32_MAX;
+}
+
+U32 HelperTaskSystemWorker::Help()
+{
+	static const U32 order[TaskPriority::TPCount] =
 	{
-		workers[1 + helper.index].PushWork(task);
+		TaskPriority::TPHigh, TaskPriority::TPNormal, TaskPriority::TPBackground
+	};
 
-		helper.index = (helper.index + 1) % workerCount;
+	U32 task;
 
-		if (helper.index != myIndex)
-			continue;
-			
-		helper.index = (helper.index + 1) % workerCount;
-		continue;
+	if (executeCount % TaskPriority::BackgroundInterval == 0 &&
+		(task = StealWork(TaskPriority::TPBackground)) != UINT32_MAX)
+		return task;
+
+	for (U32 i = 0; i < TaskPriority::TPCount; i++)
+	{
+		if ((task = StealWork(order[i])) != UINT32_MAX)
+			return task;
 	}
 
+	return UINT32_MAX;
+}
 
-	// Split work from workers
+U32 HelperTaskSystemWorker::Sleep(TaskPredicate predicate, void* args)
+{
+	TaskSystemHelper& helper = taskSystem->helper;
+	U32 task;
 
+	// Spin while work usually shows up within our budget, but never on more than the allowed
+	// number of workers at once
 
-	// Steal work
+	TimePoint start = Clock::now();
 
-	if (myIndex == UINT32_MAX)
+	if (helper.spinning.fetch_add(1, std::memory_order_relaxed) < taskSystem->maxSpinningWorkers)
 	{
-		for (U32 i = 0; i < workerCount; i++)
+		task = Spin(start, spinBudget, predicate, args);
+		U32 spinners = helper.spinning.fetch_sub(1, std::memory_order_seq_cst);
+
+		WORKER_STAT(this, WSSpinNanoseconds, std::chrono::nanoseconds(Clock::now() - start).count());
+
+		if (task != UINT32_MAX)
 		{
-			if ((task = taskSystem->workers[1 + i].workList.tryPop()) != UINT32_MAX)
-			{
-				PushWork(task);
-				taskSystem->helper.lock.unlock();
-				return 1;
-			}
+			// submitters skipped their wake while we spun, the last spinner to find work hands
+			// the role on
+			if (spinners == 1)
+				WakeSleepers(1);
+
+			LearnIdleTime(std::chrono::nanoseconds(Clock::now() - start).count());
+			return task;
 		}
 	}
 	else
 	{
-		for (U32 i = 0; i < myIndex; i++)
+		helper.spinning.fetch_sub(1, std::memory_order_seq_cst);
+	}
+
+	// Announce ourselves before the final check, submitters publish work before reading the mask
+
+	std::atomic<U64>& mask = helper.sleepingMask[index / 64];
+	U64 bit = (U64)1 << (index % 64);
+
+	parked.val.val.store(1, std::memory_order_relaxed);
+	helper.sleeping.fetch_add(1, std::memory_order_seq_cst);
+	mask.fetch_or(bit, std::memory_order_seq_cst);
+
+	// RunUntil checks its predicate here as well, Wake only finds us once our bit is set
+	if ((task = Help()) == UINT32_MAX && (predicate == nullptr || !predicate(args)))
+	{
+		WORKER_STAT(this, WSSleeps, 1);
+		WORKER_TRACE(this, TESleep, UINT32_MAX);
+
+		// with timers pending one parked worker wakes up for the next one that is due
+		U32 timeout = TimerTimeout(1);
+		Bool keeper = timeout != UINT32_MAX, timedOut = 0;
+
+		// the waker clears our bit and then our futex
+		while (parked.val.val.load(std::memory_order_acquire) != 0)
 		{
-			if ((task = taskSystem->workers[1 + i].workList.tryPop()) != UINT32_MAX)
+			if (parked.val.Wait(1, timeout))
+				continue;
+
+			// take our bit back unless a waker got there first, then it is about to clear our futex
+			if ((mask.fetch_and(~bit, std::memory_order_acq_rel) & bit) != 0)
 			{
-				PushWork(task);
-				taskSystem->helper.lock.unlock();
-				return 1;
+				helper.sleeping.fetch_sub(1, std::memory_order_relaxed);
+				timedOut = 1;
+				break;
 			}
+
+			timeout = UINT32_MAX;
 		}
 
-		for (U32 i = myIndex + 1; i < workerCount; i++)
+		WORKER_TRACE(this, TEWake, UINT32_MAX);
+
+		if (keeper)
 		{
-			if ((task = taskSystem->workers[1 + i].workList.tryPop()) != UINT32_MAX)
-			{
-				PushWork(task);
-				taskSystem->helper.lock.unlock();
-				return 1;
-			}
-		}
-	}
+			TimerWheel& timers = taskSystem->timers;
 
+			timers.Lock();
+			timers.keeper = UINT32_MAX;
+			timers.keeperTick = UINT64_MAX;
+			timers.Unlock();
 
-	// Sleep
+			(void)PollTimers();
 
-	if (!allowSleep)
+			// we were woken for work, leave the timers to another parked worker
+			if (!timedOut && timers.count.load(std::memory_order_relaxed) != 0)
+				WakeSleepers(1);
+		}
+	}
+	else if ((mask.fetch_and(~bit, std::memory_order_acq_rel) & bit) != 0)
 	{
-		taskSystem->helper.lock.unlock();
-		return 1;
+		helper.sleeping.fetch_sub(1, std::memory_order_relaxed);
+	}
+	else
+	{
+		// a waker already picked us, let it finish before the futex is armed again
+		while (parked.val.val.load(std::memory_order_acquire) != 0)
+			CpuPause();
 	}
-	
-	I32 tmp = helper.state.val.load(std::memory_order_acquire);
+
+	LearnIdleTime(std::chrono::nanoseconds(Clock::now() - start).count());
+	return task;
+}
+
+U32 HelperTaskSystemWorker::Spin(TimePoint start, I64 budget, TaskPredicate predicate, void* args)
+{
+	U32 task, pauses = 1;
+
 	while (true)
 	{
-		I32 target = (tmp >= 1 && tmp <= 2) ? tmp - 1 : tmp;
-		if (helper.state.val.compare_exchange_strong(tmp, target))
+		if ((task = Help()) != UINT32_MAX)
+			return task;
+
+		if (predicate != nullptr && predicate(args))
+			return UINT32_MAX;
+
+		I64 elapsed = std::chrono::nanoseconds(Clock::now() - start).count();
+
+		if (elapsed >= budget)
+			return UINT32_MAX;
+
+		// back off exponentially for the first half, then give the core to other threads
+		if (elapsed < budget / 2)
 		{
-			if (tmp >= 0 && tmp <= 1)
-				helper.state.Wait(0, UINT32_MAX);
+			for (U32 i = 0; i < pauses; i++)
+				CpuPause();
 
-			break;
+			if (pauses < 0x100)
+				pauses <<= 1;
+		}
+		else
+		{
+			std::this_thread::yield();
 		}
 	}
+}
+
+void HelperTaskSystemWorker::LearnIdleTime(I64 nanoseconds)
+{
+	I64 maxSpin = (I64)taskSystem->spinNanoseconds;
 
-	taskSystem->helper.lock.unlock();
-	return 1;
+	// a long quiet phase should not keep us from spinning for ages once work picks up again
+	if (nanoseconds > maxSpin * 4)
+		nanoseconds = maxSpin * 4;
+
+	idleEstimate += (nanoseconds - idleEstimate) / 4;
+
+	// spin twice as long as work usually takes to show up, if it usually takes longer than we may
+	// spin, only spin briefly to catch work that is submitted right behind the last task
+	if (idleEstimate * 2 <= maxSpin)
+		spinBudget = idleEstimate * 2;
+	else if (idleEstimate <= maxSpin)
+		spinBudget = maxSpin;
+	else
+		spinBudget = maxSpin / 0x40;
 }
 
-void HelperTaskSystemWorker::Sleep()
+void HelperTaskSystemWorker::WakeWorker(U32 index)
 {
-	while (true)
+	TaskSystemHelper& helper = taskSystem->helper;
+	U64 bit = (U64)1 << (index % 64);
+
+	// not parked yet or already woken, either way it looks at the new state by itself
+	if ((helper.sleepingMask[index / 64].fetch_and(~bit, std::memory_order_acq_rel) & bit) == 0)
+		return;
+
+	HelperTaskSystemWorker& sleeper = taskSystem->workers[index];
+	helper.sleeping.fetch_sub(1, std::memory_order_relaxed);
+	sleeper.parked.val.val.store(0, std::memory_order_release);
+	sleeper.parked.val.WakeSingle();
+}
+
+U32 HelperTaskSystemWorker::PollTimers()
+{
+	TimerWheel& timers = taskSystem->timers;
+
+	// the tasks submitted below may wait on others and poll again while we walk firedTimers
+	if (pollingTimers || timers.count.load(std::memory_order_relaxed) == 0 ||
+		!timers.TryAdvance(timers.Now(), firedTimers))
+		return 0;
+
+	pollingTimers = 1;
+	U32 count = (U32)firedTimers.size();
+
+	for (U32 i = 0; i < count; i++)
+		SubmitTask(NewTask(firedTimers[i].function, firedTimers[i].args, TaskHandle(), TaskHandle()));
+
+	firedTimers.clear();
+	pollingTimers = 0;
+	return count;
+}
+
+U32 HelperTaskSystemWorker::TimerTimeout(Bool claim)
+{
+	TimerWheel& timers = taskSystem->timers;
+
+	if (timers.count.load(std::memory_order_relaxed) == 0)
+		return UINT32_MAX;
+
+	timers.Lock();
+
+	U64 tick = timers.NextTick();
+
+	if (tick == UINT64_MAX || timers.keeper != UINT32_MAX)
 	{
-		if (Help(true))
-			return;
+		timers.Unlock();
+		return UINT32_MAX;
+	}
 
-		if (taskSystem->helper.state.val.load(std::memory_order_relaxed) == 0)
-			break;
+	if (claim)
+	{
+		timers.keeper = index;
+		timers.keeperTick = tick;
+	}
+
+	timers.Unlock();
+	return timers.MillisecondsUntil(tick);
+}
 
-		TimePoint start = Clock::now();
+void HelperTaskSystemWorker::WakeSleepers(U32 count)
+{
+	TaskSystemHelper& helper = taskSystem->helper;
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (helper.sleeping.load(std::memory_order_relaxed) == 0)
+		return;
+
+	HelperTaskSystemWorker* workers = taskSystem->workers;
+	U32 maskWords = (taskSystem->workerCount + taskSystem->externalSubmitterCount + 63) / 64;
+	U32 woken = 0;
 
-		while (std::chrono::nanoseconds(Clock::now() - start).count() < 100000)
+	// start with our own word, our neighbours are the most likely to share caches with us
+	for (U32 i = 0; i < maskWords && woken < count; i++)
+	{
+		U32 word = (index / 64 + i) % maskWords;
+		std::atomic<U64>& mask = helper.sleepingMask[word];
+		U64 bits = mask.load(std::memory_order_relaxed);
+
+		while (bits != 0 && woken < count)
 		{
-			if (!workList.IsEmpty())
-				return;
+			U64 bit = bits & (~bits + 1);
+			bits = mask.fetch_and(~bit, std::memory_order_acq_rel);
+
+			// another waker or the sleeper itself got there first
+			if ((bits & bit) == 0)
+				continue;
+
+			bits &= ~bit;
+
+			HelperTaskSystemWorker& sleeper = workers[word * 64 + CountTrailingZeros(bit)];
+			helper.sleeping.fetch_sub(1, std::memory_order_relaxed);
+			sleeper.parked.val.val.store(0, std::memory_order_release);
+			sleeper.parked.val.WakeSingle();
+			woken++;
 		}
 	}
 
-	I32 tmp = state.val.load(std::memory_order_acquire);
-	while (true)
+	WORKER_STAT(this, WSWakesRequested, woken);
+}
+
+void HelperTaskSystemWorker::ReleaseSuccessors(U32 index, U32 result)
+{
+	LockFreeTaskNode& node = taskNodes[index];
+	U32 generation = node.generation.load(std::memory_order_relaxed);
+
+	// closing the list makes later AddDependency calls see the dependency as finished
+	U64 successors = node.task.successors.exchange(TaskSuccessors::Pack(generation, TaskSuccessors::TSClosed),
+		std::memory_order_acq_rel);
+	U32 successor = TaskSuccessors::First(successors);
+
+	while (successor != TaskSuccessors::TSEmpty)
 	{
-		I32 target = (tmp >= 1 && tmp <= 2) ? tmp - 1 : tmp;
-		if (state.val.compare_exchange_strong(tmp, target))
+		LockFreeTaskNode& successorNode = taskNodes[successor];
+		U32 task = successorNode.task.parent.index;
+		U32 next = successorNode.next.load(std::memory_order_relaxed);
+
+		if ((successorNode.task.flags & TaskFlags::TFWaiter) != 0)
 		{
-			if (tmp >= 0 && tmp <= 1)
-			{
-				if (Help(true))
-					return;
+			// the waiter may return as soon as it sees the store, waking a stale address is harmless
+			Futex* waiter = (Futex*)successorNode.task.args;
+			waiter->val.store((I32)result + 1, std::memory_order_release);
+			waiter->WakeSingle();
+		}
+		else if (taskNodes[task].task.pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			PushWork(task);
+		}
 
-				state.Wait(0, UINT32_MAX);
-			}
+		PushDone(successor);
+		successor = next;
+	}
+}
 
-			break;
-		}
+void HelperTaskSystemWorker::FailTask(U32 index)
+{
+	while (index != UINT32_MAX)
+	{
+		Task& task = taskNodes[index].task;
+
+		// the rest of the chain is marked already
+		if (task.result.exchange(TaskResult::TRFailed, std::memory_order_relaxed) == TaskResult::TRFailed)
+			return;
+
+		taskSystem->helper.failing.fetch_add(1, std::memory_order_relaxed);
+
+		index = task.parent.index;
 	}
 }
 
-void HelperTaskSystemWorker::Wake()
+Bool HelperTaskSystemWorker::TreeFailed(U32 index)
 {
-	I32 tmp = state.val.load(std::memory_order_acquire);
-	while (true)
+	// a failed ancestor is unfinished while we are, so it is counted in failing
+	if (taskSystem->helper.failing.load(std::memory_order_relaxed) == 0)
+		return 0;
+
+	// FailTask only marks upwards, a failure in a sibling subtree shows at the common ancestor
+	while (index != UINT32_MAX)
 	{
-		I32 target = (tmp >= 0 && tmp <= 1) ? tmp + 1 : tmp;
-		if (state.val.compare_exchange_strong(tmp, target))
-		{
-			if (tmp == 0)
-				state.WakeSingle();
+		Task& task = taskNodes[index].task;
 
-			break;
-		}
+		if (task.result.load(std::memory_order_relaxed) == TaskResult::TRFailed)
+			return 1;
+
+		index = task.parent.index;
 	}
+
+	return 0;
 }
 
 void HelperTaskSystemWorker::FinishTask(U32 index)
 {
-	LockFreeTaskNode& node = workList.taskNodes[index];
+	LockFreeTaskNode& node = taskNodes[index];
 	U32 count = node.task.count.fetch_sub((U32)1, std::memory_order_seq_cst);
 
 	if (count == 1)
 	{
+		U32 result = node.task.result.load(std::memory_order_relaxed);
+
+		if (result == TaskResult::TRFailed)
+			taskSystem->helper.failing.fetch_sub(1, std::memory_order_relaxed);
+
+		// the task most likely returned early when its token was canceled while it ran
+		if (result == TaskResult::TROk && (node.task.flags & TaskFlags::TFToken) != 0 &&
+			node.storage.token->IsCanceled())
+			result = TaskResult::TRCanceled;
+
+		if ((node.task.flags & TaskFlags::TFStorage) != 0)
+			node.storage.destroy(node.storage.bytes);
+
+		ReleaseSuccessors(index, result);
+
+		// invalidates all handles to this task and leaves the result for waiters, they acquire the
+		// results of the task through it
+		U32 generation = node.generation.load(std::memory_order_relaxed);
+		node.generation.store(TaskResult::NextGeneration(generation, result), std::memory_order_release);
+
 		if (node.task.parent.index != UINT32_MAX)
+		{
+			// a failure marked the parent already, a cancellation only reaches it from here
+			if (result == TaskResult::TRCanceled)
+			{
+				U32 parentResult = TaskResult::TROk;
+				taskNodes[node.task.parent.index].task.result.compare_exchange_strong(parentResult,
+					TaskResult::TRCanceled, std::memory_order_relaxed);
+			}
+
 			FinishTask(node.task.parent.index);
+		}
 
 		PushDone(index);
 	}
@@ -365,22 +964,50 @@ void HelperTaskSystemWorker::FinishTask(U32 index)
 
 void HelperTaskSystemWorker::ExecuteTask(U32 index)
 {
-	Task& t = workList.taskNodes[index].task;
+	LockFreeTaskNode& node = taskNodes[index];
+	Task& t = node.task;
+	executeCount++;
+
+	WORKER_STAT(this, WSTasksExecuted, 1);
+	WORKER_TRACE(this, TEBegin, index);
 
-	if (t.dependency.index != UINT32_MAX && workList.taskNodes[t.dependency.index].generation.load(
-		std::memory_order_relaxed) == t.dependency.generation)
+	// the token was canceled or a failure elsewhere in the tree marked an ancestor before we got
+	// to run
+	if (((t.flags & TaskFlags::TFToken) != 0 && node.storage.token->IsCanceled()) ||
+		(t.parent.index != UINT32_MAX && TreeFailed(t.parent.index)))
 	{
-		SubmitTask(TaskHandle(index, workList.taskNodes[index].generation.load(std::memory_order_relaxed)));
-		return;
+		// a child that threw before we ran marked us failed already, the worse result stays
+		U32 result = TaskResult::TROk;
+		t.result.compare_exchange_strong(result, TaskResult::TRCanceled, std::memory_order_relaxed);
 	}
+	else if (t.function != nullptr)
+	{
+		U32 previousTask = currentTask;
+		TaskArenaMark mark = arena.Mark();
+		currentTask = index;
 
-	if (t.function != nullptr)
+#if defined(CPP_HAS_EXCEPTIONS)
+		try
+		{
+			t.function(this, t.args);
+		}
+		catch (...)
+		{
+			FailTask(index);
+		}
+#else
 		t.function(this, t.args);
+#endif
+
+		arena.Reset(mark);
+		currentTask = previousTask;
+	}
+
+	WORKER_TRACE(this, TEEnd, index);
 
 	FinishTask(index);
 }
 
-// Do not pass a submitted task as parent
 TaskHandle HelperTaskSystemWorker::NewTask(
 	TaskFunction	function,
 	void*			args,
@@ -389,59 +1016,378 @@ TaskHandle HelperTaskSystemWorker::NewTask(
 )
 {
 	U32 index = PopFree();
-	LockFreeTaskNode& node = workList.taskNodes[index];
+	LockFreeTaskNode& node = taskNodes[index];
+	U32 generation = node.generation.load(std::memory_order_relaxed);
 	node.task.function = function;
 	node.task.args = args;
-	node.task.dependency = dependency;
 	node.task.parent = parent;
-	node.task.flags = 0;
+	node.task.flags = TaskPriority::TPNormal;
 	node.task.count.store(1, std::memory_order_relaxed);
+	node.task.pending.store(1, std::memory_order_relaxed);
+	node.task.result.store(TaskResult::TROk, std::memory_order_relaxed);
+	node.task.successors.store(TaskSuccessors::Pack(generation, TaskSuccessors::TSEmpty), std::memory_order_release);
 
 	if (parent.index != UINT32_MAX)
 	{
-		LockFreeTaskNode& parentNode = workList.taskNodes[parent.index];
-		parentNode.task.count.store(parentNode.task.count.load(std::memory_order_relaxed) + 1,
-			std::memory_order_relaxed);
+		Task& parentTask = taskNodes[parent.index].task;
+		parentTask.count.fetch_add(1, std::memory_order_relaxed);
+		node.task.flags = parentTask.flags & (TaskFlags::TFPriorityMask | TaskFlags::TFToken);
+
+		if ((parentTask.flags & TaskFlags::TFToken) != 0)
+			node.storage.token = taskNodes[parent.index].storage.token;
 	}
 
-	return TaskHandle(index, node.generation.load(std::memory_order_relaxed));
+	TaskHandle task(index, generation);
+
+	if (dependency.index != UINT32_MAX)
+		AddDependency(task, dependency);
+
+	return task;
 }
 
-// Do not create child tasks after you submitted the parent
+// Only the task itself and its running descendants may create children of it once it is submitted
 void HelperTaskSystemWorker::SubmitTask(TaskHandle task)
 {
-	if (taskSystem->helper.queue.push(task.index))
+	// drop the submission reference, the last finished dependency queues the task otherwise
+	if (taskNodes[task.index].task.pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		PushWork(task.index);
+}
+
+void HelperTaskSystemWorker::AddDependency(TaskHandle task, TaskHandle dependency)
+{
+	U64 tmp = taskNodes[dependency.index].task.successors.load(std::memory_order_acquire);
+
+	if (TaskSuccessors::Generation(tmp) != dependency.generation ||
+		TaskSuccessors::First(tmp) == TaskSuccessors::TSClosed)
+		return;
+
+	U32 successor = PopFree();
+	LockFreeTaskNode& successorNode = taskNodes[successor];
+	successorNode.task.function = (TaskFunction)nullptr;
+	successorNode.task.args = nullptr;
+	successorNode.task.parent = task;
+	successorNode.task.flags = 0;
+
+	taskNodes[task.index].task.pending.fetch_add(1, std::memory_order_relaxed);
+
+	if (!PushSuccessor(dependency, successor))
+	{
+		// finished in the meantime, the submission reference keeps pending above 0
+		taskNodes[task.index].task.pending.fetch_sub(1, std::memory_order_relaxed);
+		PushDone(successor);
+	}
+}
+
+Bool HelperTaskSystemWorker::PushSuccessor(TaskHandle dependency, U32 successor)
+{
+	std::atomic<U64>& successors = taskNodes[dependency.index].task.successors;
+	U64 tmp = successors.load(std::memory_order_acquire);
+
+	while (true)
+	{
+		if (TaskSuccessors::Generation(tmp) != dependency.generation ||
+			TaskSuccessors::First(tmp) == TaskSuccessors::TSClosed)
+			return 0;
+
+		taskNodes[successor].next.store(TaskSuccessors::First(tmp), std::memory_order_relaxed);
+
+		if (successors.compare_exchange_weak(tmp, TaskSuccessors::Pack(dependency.generation, successor),
+			std::memory_order_release, std::memory_order_acquire))
+			return 1;
+	}
+}
+
+void HelperTaskSystemWorker::SetPriority(TaskHandle task, U32 priority)
+{
+	U32& flags = taskNodes[task.index].task.flags;
+	flags = (flags & ~(U32)TaskFlags::TFPriorityMask) | (priority & TaskFlags::TFPriorityMask);
+}
+
+void HelperTaskSystemWorker::SetCancellationToken(TaskHandle task, CancellationToken* token)
+{
+	LockFreeTaskNode& node = taskNodes[task.index];
+
+	if (token == nullptr)
+	{
+		node.task.flags &= ~(U32)TaskFlags::TFToken;
+		return;
+	}
+
+	node.task.flags |= TaskFlags::TFToken;
+	node.storage.token = token;
+}
+
+U32 HelperTaskSystemWorker::GetPriority(TaskHandle task)
+{
+	return TaskFlags::Priority(taskNodes[task.index].task.flags);
+}
+
+CancellationToken* HelperTaskSystemWorker::GetCancellationToken(TaskHandle task)
+{
+	LockFreeTaskNode& node = taskNodes[task.index];
+	return (node.task.flags & TaskFlags::TFToken) != 0 ? node.storage.token : nullptr;
+}
+
+void* HelperTaskSystemWorker::AttachStorage(TaskHandle task, TaskStorageDestructor destroy)
+{
+	LockFreeTaskNode& node = taskNodes[task.index];
+	node.task.flags |= TaskFlags::TFStorage;
+	node.task.args = node.storage.bytes;
+	node.storage.destroy = destroy;
+	return node.storage.bytes;
+}
+
+void HelperTaskSystemWorker::NewTasks(
+	U32				count,
+	TaskFunction	function,
+	void**			args,
+	TaskHandle		parent,
+	TaskHandle*		outHandles
+)
+{
+	U32 flags = parent.index != UINT32_MAX ?
+		taskNodes[parent.index].task.flags & (TaskFlags::TFPriorityMask | TaskFlags::TFToken) :
+		(U32)TaskPriority::TPNormal;
+	CancellationToken* token = (flags & TaskFlags::TFToken) != 0 ? taskNodes[parent.index].storage.token :
+		(CancellationToken*)nullptr;
+
+	for (U32 i = 0; i < count; i++)
+	{
+		// walk the worker free list directly, PopFree refills it one allocator block at a time
+		U32 index = freeListStart;
+
+		if (index != UINT32_MAX)
+			freeListStart = taskNodes[index].freeNext;
+		else
+			index = PopFree();
+
+		LockFreeTaskNode& node = taskNodes[index];
+		U32 generation = node.generation.load(std::memory_order_relaxed);
+		node.task.function = function;
+		node.task.args = args != nullptr ? args[i] : nullptr;
+		node.task.parent = parent;
+		node.task.flags = flags;
+		node.task.count.store(1, std::memory_order_relaxed);
+		node.task.pending.store(1, std::memory_order_relaxed);
+		node.task.result.store(TaskResult::TROk, std::memory_order_relaxed);
+		node.task.successors.store(TaskSuccessors::Pack(generation, TaskSuccessors::TSEmpty),
+			std::memory_order_release);
+
+		if (token != nullptr)
+			node.storage.token = token;
+
+		outHandles[i] = TaskHandle(index, generation);
+	}
+
+	if (parent.index != UINT32_MAX)
+		taskNodes[parent.index].task.count.fetch_add(count, std::memory_order_relaxed);
+}
+
+void HelperTaskSystemWorker::SubmitTasks(const TaskHandle* tasks, U32 count)
+{
+	U32 ready = 0;
+
+	// tasks without open dependencies go out as one batch, the rest wait for their dependencies
+	while (ready < count &&
+		taskNodes[tasks[ready].index].task.pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		ready++;
+
+	if (ready != count)
 	{
-		TaskSystemHelper& helper = taskSystem->helper;
-		I32 tmp = helper.state.val.load(std::memory_order_acquire);
-		while (true)
+		for (U32 i = ready + 1; i < count; i++)
+			SubmitTask(tasks[i]);
+
+		count = ready;
+	}
+
+	if (count == 0)
+		return;
+
+	// a batch goes into one deque, mixed priorities take the single task path
+	U32 priority = TaskFlags::Priority(taskNodes[tasks[0].index].task.flags);
+
+	for (U32 i = 1; i < count; i++)
+	{
+		if (TaskFlags::Priority(taskNodes[tasks[i].index].task.flags) != priority)
 		{
-			I32 target = (tmp >= 0 && tmp <= 1) ? tmp + 1 : tmp;
-			if (helper.state.val.compare_exchange_strong(tmp, target))
-			{
-				if (tmp == 0)
-					helper.state.WakeSingle();
+			for (U32 j = 0; j < count; j++)
+				PushWork(tasks[j].index);
 
-				break;
-			}
+			return;
 		}
 	}
+
+	if (priority == TaskPriority::TPHigh)
+		taskSystem->helper.highCount.fetch_add(count, std::memory_order_relaxed);
+
+	if (workLists[priority].push(tasks, count))
+		WORKER_STAT(this, WSDequeGrowths, 1);
+
+	WakeSleepers(count);
 }
 
-void HelperTaskSystemWorker::WaitOnTask(TaskHandle task)
+U32 HelperTaskSystemWorker::WaitOnTask(TaskHandle task)
 {
-	U32 tmp;
+	Futex finished(0);
+	U32 waiter = UINT32_MAX, tmp, generation;
+
 	while (true)
 	{
-		if (workList.taskNodes[task.index].generation.load(std::memory_order_relaxed) != task.generation)
-			return;
+		if (waiter != UINT32_MAX)
+		{
+			if (finished.val.load(std::memory_order_acquire) != 0)
+				break;
+		}
+		else if ((generation = taskNodes[task.index].generation.load(std::memory_order_acquire)) != task.generation)
+		{
+			break;
+		}
 
-		if ((tmp = TryPopWork()) != UINT32_MAX)
+		if ((tmp = TryPopWork()) != UINT32_MAX || (tmp = Help()) != UINT32_MAX)
 		{
 			ExecuteTask(tmp);
 			continue;
 		}
 
-		(void)Help(false);
+		if (PollTimers() != 0)
+			continue;
+
+		// nothing to run, register on the task once and park until FinishTask hands us the result
+		if (waiter == UINT32_MAX)
+		{
+			waiter = PopFree();
+			LockFreeTaskNode& waiterNode = taskNodes[waiter];
+			waiterNode.task.function = (TaskFunction)nullptr;
+			waiterNode.task.args = &finished;
+			waiterNode.task.parent = TaskHandle();
+			waiterNode.task.flags = TaskFlags::TFWaiter;
+
+			// the successor list closes before the generation moves on, go around until it did
+			if (!PushSuccessor(task, waiter))
+			{
+				PushDone(waiter);
+				waiter = UINT32_MAX;
+			}
+
+			continue;
+		}
+
+		WORKER_STAT(this, WSSleeps, 1);
+		WORKER_TRACE(this, TESleep, UINT32_MAX);
+
+		// without a parked helper keeping the timers, wake up for them ourselves. We are not in the
+		// sleeping mask and do not count as idle, nothing but the finish wakes us for split off work.
+		finished.Wait(0, TimerTimeout(0));
+
+		WORKER_TRACE(this, TEWake, UINT32_MAX);
+	}
+
+	if (waiter != UINT32_MAX)
+		return (U32)finished.val.load(std::memory_order_relaxed) - 1;
+
+	return TaskResult::Get(task.generation, generation);
+}
+
+void HelperTaskSystemWorker::RunUntil(TaskPredicate predicate, void* args)
+{
+	std::atomic<U32>& idle = taskSystem->helper.idle;
+	U32 task;
+
+	while (!predicate(args))
+	{
+		if (executeCount % TimerWheel::PollInterval == 0)
+			(void)PollTimers();
+
+		if ((task = TryPopWork()) == UINT32_MAX)
+		{
+			idle.fetch_add(1, std::memory_order_relaxed);
+			task = Sleep(predicate, args);
+			idle.fetch_sub(1, std::memory_order_relaxed);
+
+			if (task == UINT32_MAX)
+				continue;
+		}
+
+		ExecuteTask(task);
 	}
 }
+
+Bool HelperTaskSystemWorker::IsCanceled()
+{
+	if (currentTask == UINT32_MAX)
+		return 0;
+
+	LockFreeTaskNode& node = taskNodes[currentTask];
+
+	if ((node.task.flags & TaskFlags::TFToken) != 0 && node.storage.token->IsCanceled())
+		return 1;
+
+	// a child failed or a failure elsewhere in the tree reached one of our ancestors
+	return TreeFailed(currentTask);
+}
+
+TaskHandle HelperTaskSystemWorker::CurrentTask()
+{
+	if (currentTask == UINT32_MAX)
+		return TaskHandle();
+
+	// the generation only moves on once the task finished
+	return TaskHandle(currentTask, taskNodes[currentTask].generation.load(std::memory_order_relaxed));
+}
+
+Bool HelperTaskSystemWorker::ShouldSplit()
+{
+	// somebody is looking for work and there is nothing left in our deques to steal
+	return workLists[TaskPriority::TPHigh].IsEmpty() && workLists[TaskPriority::TPNormal].IsEmpty() &&
+		workLists[TaskPriority::TPBackground].IsEmpty() && taskSystem->helper.idle.load(std::memory_order_relaxed) != 0;
+}
+
+void* HelperTaskSystemWorker::AllocateScratch(UPtr size, UPtr alignment)
+{
+	return arena.Allocate(size, alignment);
+}
+
+TimerHandle HelperTaskSystemWorker::SubmitTimer(
+	TaskFunction	function,
+	void*			args,
+	U32				delayMilliseconds,
+	U32				periodMilliseconds
+)
+{
+	TimerWheel& timers = taskSystem->timers;
+
+	timers.Lock();
+
+	U64 next = timers.NextTick();
+	TimerHandle timer = timers.Add(function, args, delayMilliseconds, periodMilliseconds);
+	U64 deadline = timers.entries[timer.index].deadline;
+	U32 keeper = timers.keeper;
+	U64 keeperTick = timers.keeperTick;
+
+	timers.Unlock();
+
+	// a parked worker has to wake up for a new earliest timer, either the keeper if it parked for
+	// longer or any worker to become the keeper. Later timers are picked up along with the earliest.
+	if (keeper != UINT32_MAX)
+	{
+		if (deadline < keeperTick)
+			WakeWorker(keeper);
+	}
+	else if (deadline < next)
+	{
+		WakeSleepers(1);
+	}
+
+	return timer;
+}
+
+Bool HelperTaskSystemWorker::CancelTimer(TimerHandle timer)
+{
+	TimerWheel& timers = taskSystem->timers;
+
+	timers.Lock();
+	Bool canceled = timers.Cancel(timer);
+	timers.Unlock();
+
+	return canceled;
+}
@@ -25,21 +25,76 @@
 #pragma once
 
 #include "LockFreeTaskNodeAllocator.hpp"
+#include "ChaseLevTaskNodeDeque.hpp"
+#include "CacheAligned.hpp"
+#include "Topology.hpp"
+#include "SchedulerStats.hpp"
+#include "TimerWheel.hpp"
+#include "TaskArena.hpp"
 #include "WorkerBase.hpp"
 
 class HelperTaskSystemWorker;
 
+// Worker 0 is the thread constructing the task system, its affinity and numa node are applied to
+// that thread as well. affinity and numaNodes hold workerCount entries or are nullptr, an empty
+// mask or numa node -1 leaves that worker alone.
+struct HelperTaskSystemConfig
+{
+	U32 workerCount;
+	U32 blockSize;
+	U32 initialBlockCount;
+	U32 maxTaskNodeCount;
+	U32 spinNanoseconds;
+	U32 maxSpinningWorkers;
+	U32 traceEventCount;
+	U32 externalSubmitterCount;
+	const CpuMask* affinity;
+	const I32* numaNodes;
+
+	// workerCount 0 picks std::thread::hardware_concurrency but at least 4, initialBlockCount 0
+	// picks workerCount * 3 blocks. spinNanoseconds caps the adaptive spin window of idle workers,
+	// maxSpinningWorkers 0 lets half of the workers spin at the same time. traceEventCount is the
+	// ring size per worker with BUILD_SCHEDULER_TRACE. externalSubmitterCount is the number of
+	// worker slots without a thread that other threads claim with AcquireExternalSubmitter.
+	HelperTaskSystemConfig()
+		: workerCount(0),
+		blockSize(0x400),
+		initialBlockCount(0),
+		maxTaskNodeCount(0x100000),
+		spinNanoseconds(100000),
+		maxSpinningWorkers(0),
+		traceEventCount(0x10000),
+		externalSubmitterCount(0),
+		affinity((const CpuMask*)nullptr),
+		numaNodes((const I32*)nullptr)
+	{}
+};
+
+// Shared state of all workers. There is no shared task queue, every submitter pushes into its own
+// growing deques and idle workers steal from them. Idle workers park on their own futex and set
+// their bit in sleepingMask, sleeping counts the set bits so submitters can skip the mask when
+// nobody sleeps. idle counts workers that are looking for work, running tasks use it to decide
+// whether splitting off work is worth it. spinning counts idle workers inside their spin window,
+// single submissions skip the wake while one of them is around to pick the task up. highCount
+// counts queued high priority tasks, so workers only look for them elsewhere when there are some.
+// failing counts unfinished tasks marked failed, while it is 0 no task has to look at its
+// ancestors before it runs.
 class CACHE_ALIGN TaskSystemHelper
 {
 public:
 
-	SpinLock lock;
-	Byte pad0[CACHE_LINE - sizeof(SpinLock)];
-	Futex state;
-	Byte pad1[CACHE_LINE - sizeof(Futex)];
-	U32 index;
-	Byte pad2[CACHE_LINE - sizeof(U32)];
-	LockFreeMPSCTaskNodeQueue queue;
+	std::atomic<U64>* sleepingMask;
+	Byte pad0[CACHE_LINE - sizeof(std::atomic<U64>*)];
+	std::atomic<U32> sleeping;
+	std::atomic<U32> idle;
+	std::atomic<U32> spinning;
+	Byte pad1[CACHE_LINE - sizeof(std::atomic<U32>) * 3];
+	std::atomic<U32> highCount;
+	Byte pad2[CACHE_LINE - sizeof(std::atomic<U32>)];
+	std::atomic<U32> failing;
+	Byte pad3[CACHE_LINE - sizeof(std::atomic<U32>)];
+
+	TaskSystemHelper();
 };
 
 class HelperTaskSystem
@@ -48,16 +103,48 @@ public:
 
 	LockFreeTaskNodeAllocator nodeAllocator;
 	TaskSystemHelper helper;
+	TimerWheel timers;
 	HelperTaskSystemWorker* workers;
 	U32 workerCount;
+	U32 externalSubmitterCount;
+	U32 spinNanoseconds;
+	U32 maxSpinningWorkers;
 	std::vector<std::thread> threads;
 
 	HelperTaskSystem(
 		WorkerBase** _mainThreadWorker = (WorkerBase**)nullptr
 	);
 
+	HelperTaskSystem(
+		const HelperTaskSystemConfig&	config,
+		WorkerBase**					_mainThreadWorker = (WorkerBase**)nullptr
+	);
+
 	~HelperTaskSystem();
 
+	void Initialize(
+		const HelperTaskSystemConfig&	config,
+		WorkerBase**					_mainThreadWorker
+	);
+
+	// Claim a free external submitter slot for the calling thread, nullptr if all of them are taken.
+	// A slot is a worker without a thread, it keeps its own free node block and deques and only the
+	// claiming thread may use it until it is released. The workers steal what it submits, WaitOnTask
+	// and an exhausted node pool run tasks on the calling thread. Release all slots before the task
+	// system is destroyed.
+	WorkerBase* AcquireExternalSubmitter();
+	void ReleaseExternalSubmitter(WorkerBase* submitter);
+
+	// Wake worker if it is parked, see WorkerBase::RunUntil. Any thread may call it.
+	void Wake(WorkerBase* worker);
+
+	// Print the counters of every worker and their sum, only with BUILD_SCHEDULER_STATS.
+	void PrintStats(std::ostream& stream);
+
+	// Write the trace rings of all workers to path as Chrome trace JSON, only with
+	// BUILD_SCHEDULER_TRACE. Call it while the workers are idle, return 0 on failure.
+	Bool WriteChromeTrace(const char* path);
+
 	static void WorkerLoop(
 		HelperTaskSystemWorker* worker
 	);
@@ -67,6 +154,10 @@ class HelperTaskSystemWorker : public WorkerBase
 {
 public:
 
+	// Thieves take up to half of a victim's backlog but at most StealBatch tasks at once, run the
+	// first one and queue the rest in their own deque.
+	enum { StealBatch = 0x40 };
+
 	HelperTaskSystem* taskSystem;
 	U32 freeListStart;
 	U32 doneListStart;
@@ -74,8 +165,28 @@ public:
 	U32 doneListSize;
 	U32 blockSize;
 	U32 index;
-	LockFreeTaskNodeQueue workList;
-	Futex state;
+	U32 executeCount;
+	U32 currentTask;
+	U32 random;
+	std::atomic<U32> claimed;
+	Bool pollingTimers;
+	I64 idleEstimate;
+	I64 spinBudget;
+	I32 numaNode;
+	CpuMask affinity;
+	LockFreeTaskNode* taskNodes;
+	ChaseLevTaskNodeDeque workLists[TaskPriority::TPCount];
+	CacheAligned<Futex> parked;
+	std::vector<TimerFire> firedTimers;
+	std::vector<U32> victims;
+	U32 victimTierEnd[CpuLocation::DCount];
+	TaskArena arena;
+#if defined(BUILD_SCHEDULER_STATS)
+	WorkerStats stats;
+#endif
+#if defined(BUILD_SCHEDULER_TRACE)
+	TraceRing trace;
+#endif
 
 	HelperTaskSystemWorker(
 		HelperTaskSystem*	taskSystem,
@@ -83,22 +194,79 @@ public:
 		U32					index
 	);
 
+	// Apply affinity and move the free list block and deques to numaNode, call on the worker thread.
+	void Pin();
+
 	void PushDone(U32 index);
 	void PushWork(U32 index);
+
+	// Take a task from our own deques, high priority tasks of other workers go before our normal
+	// ones, their normal tasks before our background ones.
 	U32 TryPopWork();
 	U32 PopWork();
 	U32 TryPopFree();
 	U32 PopFree();
 
-	U32 Help(Bool allowSleep);
+	// Sort the other workers into victims by how far they sit from us, nearest tier first.
+	// locations holds one entry per worker.
+	void BuildStealOrder(const CpuLocation* locations);
+
+	// Run the first of count stolen tasks of priority and queue the rest in our own deque. Return
+	// the one to run.
+	U32 KeepStolen(const U32* indices, U32 count, U32 priority);
+
+	// Steal a batch of tasks of priority from another worker, return the one to run or UINT32_MAX.
+	U32 StealWork(U32 priority);
+
+	// Steal a task of any priority from another worker, return UINT32_MAX if none.
+	U32 Help();
+
+	// Park until work is submitted, may return a task found while going to sleep. A predicate that
+	// holds keeps us from parking or ends the spin early.
+	U32 Sleep(TaskPredicate predicate = (TaskPredicate)nullptr, void* args = nullptr);
+
+	// Look for work with growing pauses, then yielding, until budget nanoseconds since start passed
+	// or predicate holds.
+	U32 Spin(TimePoint start, I64 budget, TaskPredicate predicate, void* args);
+
+	// Fold the time it took for work to show up into idleEstimate and derive the next spin budget.
+	void LearnIdleTime(I64 nanoseconds);
+
+	// Wake the worker at index if it is parked.
+	void WakeWorker(U32 index);
+
+	// Submit the tasks of all timers that are due and return how many. Busy workers call it every
+	// TimerWheel::PollInterval tasks, the keeper after its timed park.
+	U32 PollTimers();
+
+	// Time until the next timer is due for a worker about to park, UINT32_MAX without timers or if
+	// another worker keeps them. claim makes us the keeper that SubmitTimer wakes for earlier timers.
+	U32 TimerTimeout(Bool claim);
+
+	// Wake up to count parked workers, each one is picked from the sleeping mask and gets its own
+	// wake call.
+	void WakeSleepers(U32 count);
+
+	// Queue all successors whose last dependency was the finished task at index and hand result to
+	// its waiters.
+	void ReleaseSuccessors(U32 index, U32 result);
+
+	// Link successor into the successor list of dependency, return 0 if dependency already finished.
+	Bool PushSuccessor(TaskHandle dependency, U32 successor);
 
-	void Sleep();
-	void Wake();
+	// Mark the task at index and all of its ancestors failed, their unstarted children get canceled.
+	void FailTask(U32 index);
+
+	// Return 1 if the task at index or one of its ancestors is marked failed. Ancestors stay alive
+	// while the task has not finished, so the chain is safe to walk. Without failing tasks anywhere
+	// it returns right away.
+	Bool TreeFailed(U32 index);
 
 	void FinishTask(U32 index);
 	void ExecuteTask(U32 index);
 
-	// Creating a child task is not thread safe. Do not pass a parent handle that was already submitted.
+	// Child registration is atomic, a submitted parent may get new children from itself or one of
+	// its running descendants, see WorkerBase::NewTask.
 	virtual TaskHandle NewTask(
 		TaskFunction	function,
 		void*			args,
@@ -107,5 +275,73 @@ public:
 	) override;
 
 	virtual void SubmitTask(TaskHandle task) override;
-	virtual void WaitOnTask(TaskHandle task) override;
-};
\ No newline at end of file
+
+	virtual void AddDependency(TaskHandle task, TaskHandle dependency) override;
+
+	virtual void SetPriority(TaskHandle task, U32 priority) override;
+
+	virtual void SetCancellationToken(TaskHandle task, CancellationToken* token) override;
+
+	virtual U32 GetPriority(TaskHandle task) override;
+
+	virtual CancellationToken* GetCancellationToken(TaskHandle task) override;
+
+	virtual void* AttachStorage(TaskHandle task, TaskStorageDestructor destroy) override;
+
+	// Takes nodes straight from the free list block, parent follows the same rules as in NewTask.
+	virtual void NewTasks(
+		U32				count,
+		TaskFunction	function,
+		void**			args,
+		TaskHandle		parent,
+		TaskHandle*		outHandles
+	) override;
+
+	virtual void SubmitTasks(const TaskHandle* tasks, U32 count) override;
+
+	virtual Bool ShouldSplit() override;
+
+	virtual Bool IsCanceled() override;
+
+	virtual TaskHandle CurrentTask() override;
+
+	virtual U32 WaitOnTask(TaskHandle task) override;
+
+	virtual void RunUntil(TaskPredicate predicate, void* args) override;
+
+	// Bumps arena, ExecuteTask resets it to where it stood when the task started.
+	virtual void* AllocateScratch(UPtr size, UPtr alignment) override;
+
+	virtual TimerHandle SubmitTimer(
+		TaskFunction	function,
+		void*			args,
+		U32				delayMilliseconds,
+		U32				periodMilliseconds
+	) override;
+
+	virtual Bool CancelTimer(TimerHandle timer) override;
+};
+
+// Holds an external submitter slot of taskSystem for its lifetime, worker is nullptr if all slots
+// were taken.
+class ExternalSubmitter
+{
+public:
+
+	HelperTaskSystem* taskSystem;
+	WorkerBase* worker;
+
+	ExternalSubmitter(HelperTaskSystem& taskSystem)
+		: taskSystem(&taskSystem),
+		worker(taskSystem.AcquireExternalSubmitter())
+	{}
+
+	~ExternalSubmitter()
+	{
+		if (worker != nullptr)
+			taskSystem->ReleaseExternalSubmitter(worker);
+	}
+
+	ExternalSubmitter(const ExternalSubmitter&) = delete;
+	ExternalSubmitter& operator=(const ExternalSubmitter&) = delete;
+};
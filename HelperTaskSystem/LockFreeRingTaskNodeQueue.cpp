@@ -0,0 +1,141 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+#include "LockFreeRingTaskNodeQueue.hpp"
+
+LockFreeRingTaskNodeQueue::LockFreeRingTaskNodeQueue(U32 capacity)
+	: cells((Cell*)nullptr),
+	mask(0),
+	pad0(),
+	pushPosition(0),
+	pad1(),
+	popPosition(0),
+	pad2()
+{
+	Initialize(capacity);
+}
+
+LockFreeRingTaskNodeQueue::~LockFreeRingTaskNodeQueue()
+{
+	Destroy();
+}
+
+void LockFreeRingTaskNodeQueue::Initialize(U32 capacity)
+{
+	if (capacity == 0)
+		return;
+
+	Destroy();
+
+	U32 size = 1;
+	while (size < capacity)
+		size <<= 1;
+
+	cells = (Cell*)AllocateAlignedBytes(sizeof(Cell) * size, CACHE_LINE);
+	mask = size - 1;
+
+	// a cell is free for the push at position i while its sequence is i
+	for (U32 i = 0; i < size; i++)
+	{
+		new (&cells[i].sequence) std::atomic<U32>(i);
+		cells[i].index = UINT32_MAX;
+	}
+
+	pushPosition.store(0, std::memory_order_relaxed);
+	popPosition.store(0, std::memory_order_relaxed);
+}
+
+void LockFreeRingTaskNodeQueue::Destroy()
+{
+	if (cells == nullptr)
+		return;
+
+	FreeAligned(cells);
+	cells = (Cell*)nullptr;
+	mask = 0;
+}
+
+Bool LockFreeRingTaskNodeQueue::push(U32 index)
+{
+	U32 position = pushPosition.load(std::memory_order_relaxed);
+
+	while (true)
+	{
+		Cell& cell = cells[position & mask];
+		I32 turn = (I32)(cell.sequence.load(std::memory_order_acquire) - position);
+
+		if (turn == 0)
+		{
+			if (pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				cell.index = index;
+				cell.sequence.store(position + 1, std::memory_order_release);
+				return 1;
+			}
+		}
+		else if (turn < 0)
+		{
+			// the cell still holds the entry from one lap ago
+			return 0;
+		}
+		else
+		{
+			position = pushPosition.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+U32 LockFreeRingTaskNodeQueue::tryPop()
+{
+	U32 position = popPosition.load(std::memory_order_relaxed);
+
+	while (true)
+	{
+		Cell& cell = cells[position & mask];
+		I32 turn = (I32)(cell.sequence.load(std::memory_order_acquire) - (position + 1));
+
+		if (turn == 0)
+		{
+			if (popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				U32 index = cell.index;
+				cell.sequence.store(position + mask + 1, std::memory_order_release);
+				return index;
+			}
+		}
+		else if (turn < 0)
+		{
+			return UINT32_MAX;
+		}
+		else
+		{
+			position = popPosition.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+Bool LockFreeRingTaskNodeQueue::IsEmpty()
+{
+	return popPosition.load(std::memory_order_relaxed) == pushPosition.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,65 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+#pragma once
+
+#include "Core.hpp"
+
+// Bounded multi producer multi consumer queue of task node indices after Dmitry Vyukov. Every cell
+// carries a sequence number that tells producers and consumers whose turn it is, a preempted
+// producer only holds back the consumer of its own cell instead of everybody behind it.
+class CACHE_ALIGN LockFreeRingTaskNodeQueue
+{
+public:
+
+	struct Cell
+	{
+		std::atomic<U32> sequence;
+		U32 index;
+	};
+
+	Cell* cells;
+	U32 mask;
+	Byte pad0[CACHE_LINE - sizeof(Cell*) - sizeof(U32)];
+	std::atomic<U32> pushPosition;
+	Byte pad1[CACHE_LINE - sizeof(std::atomic<U32>)];
+	std::atomic<U32> popPosition;
+	Byte pad2[CACHE_LINE - sizeof(std::atomic<U32>)];
+
+	LockFreeRingTaskNodeQueue(U32 capacity = 0);
+	~LockFreeRingTaskNodeQueue();
+
+	// capacity is rounded up to a power of two
+	void Initialize(U32 capacity);
+	void Destroy();
+
+	// return 0 if queue is full
+	Bool push(U32 index);
+
+	// return UINT32_MAX if queue is empty or the next push is still in progress
+	U32 tryPop();
+
+	Bool IsEmpty();
+};
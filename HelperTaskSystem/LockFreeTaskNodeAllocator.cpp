@@ -22,14 +22,75 @@
 * SOFTWARE.
 **************************************************************************************************/
 
+
 #include "LockFreeTaskNodeAllocator.hpp"
 
-LockFreeTaskNodeAllocator::LockFreeTaskNodeAllocator(U32 blockCount, U32 blockSize)
-	: taskNodeCount(0),
+#if SYSTEM_WINDOWS
+
+#include <Windows.h>
+
+static UPtr PageSize()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (UPtr)info.dwPageSize;
+}
+
+static void* ReserveBytes(UPtr count)
+{
+	return VirtualAlloc(nullptr, count, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+static Bool CommitBytes(void* memory, UPtr count)
+{
+	return VirtualAlloc(memory, count, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+}
+
+static void ReleaseBytes(void* memory, UPtr count)
+{
+	VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+#else
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+static UPtr PageSize()
+{
+	return (UPtr)sysconf(_SC_PAGESIZE);
+}
+
+static void* ReserveBytes(UPtr count)
+{
+	void* memory = mmap(nullptr, count, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return memory != MAP_FAILED ? memory : nullptr;
+}
+
+static Bool CommitBytes(void* memory, UPtr count)
+{
+	return mprotect(memory, count, PROT_READ | PROT_WRITE) == 0;
+}
+
+static void ReleaseBytes(void* memory, UPtr count)
+{
+	munmap(memory, count);
+}
+
+#endif
+
+LockFreeTaskNodeAllocator::LockFreeTaskNodeAllocator(U32 blockCount, U32 blockSize, U32 maxTaskNodeCount)
+	: taskNodes((LockFreeTaskNode*)nullptr),
+	taskNodeCount(0),
+	maxTaskNodeCount(0),
 	blockSize(0),
+	growBlockCount(0),
+	growLock(),
+	usedBlockCount(0),
+	maxUsedBlockCount(0),
 	freeTaskNodeList()
 {
-	Initialize(blockCount, blockSize);
+	Initialize(blockCount, blockSize, maxTaskNodeCount);
 }
 
 LockFreeTaskNodeAllocator::~LockFreeTaskNodeAllocator()
@@ -37,49 +98,140 @@ LockFreeTaskNodeAllocator::~LockFreeTaskNodeAllocator()
 	Destroy();
 }
 
-void LockFreeTaskNodeAllocator::Initialize(U32 blockCount, U32 blockSize)
+void LockFreeTaskNodeAllocator::Initialize(U32 blockCount, U32 blockSize, U32 maxTaskNodeCount)
 {
 	// task nodes
 	if (blockCount == 0 || blockSize == 0)
 		return;
 
+	U32 slabSize = blockCount * blockSize;
+
+	if (maxTaskNodeCount < slabSize)
+		maxTaskNodeCount = slabSize;
+
+	// indices UINT32_MAX and UINT32_MAX - 1 are reserved as list markers
+	U64 slabCount = ((U64)maxTaskNodeCount + slabSize - 1) / slabSize;
+
+	if (slabCount * slabSize > (U64)UINT32_MAX - 1)
+		slabCount = ((U64)UINT32_MAX - 1) / slabSize;
+
 	this->blockSize = blockSize;
-	taskNodeCount = blockCount * blockSize;
-	freeTaskNodeList.taskNodes = new LockFreeTaskNode[taskNodeCount];
+	this->maxTaskNodeCount = (U32)(slabCount * slabSize);
+	growBlockCount = blockCount;
+	taskNodeCount.store(0, std::memory_order_relaxed);
+	usedBlockCount.store(0, std::memory_order_relaxed);
+	maxUsedBlockCount.store(0, std::memory_order_relaxed);
 
-	for (U32 i = 0; i < taskNodeCount; i++)
-	{
-		if (((i + 1) % blockSize) == 0)
-			freeTaskNodeList.taskNodes[i].task.dependency.index = UINT32_MAX;
-		else
-			freeTaskNodeList.taskNodes[i].task.dependency.index = i + 1;
-
-		if ((i % blockSize) == 0)
-		{
-			U32 next = i + blockSize;
-			if (taskNodeCount > next)
-				freeTaskNodeList.taskNodes[i].next.store(next, std::memory_order_relaxed);
-			else
-				freeTaskNodeList.taskNodes[i].next.store(UINT32_MAX, std::memory_order_relaxed);
-		}
-	}
+	taskNodes = (LockFreeTaskNode*)ReserveBytes((UPtr)this->maxTaskNodeCount * sizeof(LockFreeTaskNode));
+	ASSERT(taskNodes != nullptr);
+
+#if defined(BUILD_LINKED_FREE_LIST)
+	freeTaskNodeList.taskNodes = taskNodes;
+#else
+	freeTaskNodeList.Initialize(this->maxTaskNodeCount / blockSize);
+#endif
 
-	freeTaskNodeList.list.first.store(0, std::memory_order_relaxed);
-	freeTaskNodeList.list.last.store(taskNodeCount - blockSize, std::memory_order_relaxed);
+	(void)Grow();
 }
 
 void LockFreeTaskNodeAllocator::Destroy()
 {
-	delete[] freeTaskNodeList.taskNodes;
+	if (taskNodes == nullptr)
+		return;
+
+	ReleaseBytes(taskNodes, (UPtr)maxTaskNodeCount * sizeof(LockFreeTaskNode));
+	taskNodes = (LockFreeTaskNode*)nullptr;
+
+#if defined(BUILD_LINKED_FREE_LIST)
+	freeTaskNodeList.taskNodes = (LockFreeTaskNode*)nullptr;
+#else
+	freeTaskNodeList.Destroy();
+#endif
 }
 
 U32 LockFreeTaskNodeAllocator::TryPop()
 {
-	return freeTaskNodeList.tryPop();
+	U32 first = freeTaskNodeList.tryPop();
+
+	if (first == UINT32_MAX)
+		return UINT32_MAX;
+
+	U32 used = usedBlockCount.fetch_add(1, std::memory_order_relaxed) + 1;
+	U32 maxUsed = maxUsedBlockCount.load(std::memory_order_relaxed);
+
+	while (maxUsed < used && !maxUsedBlockCount.compare_exchange_weak(maxUsed, used, std::memory_order_relaxed));
+
+	return first;
 }
 
 void LockFreeTaskNodeAllocator::Push(U32 first, U32 last)
 {
-	freeTaskNodeList.taskNodes[last].task.dependency.index = UINT32_MAX;
+	taskNodes[last].freeNext = UINT32_MAX;
+	usedBlockCount.fetch_sub(1, std::memory_order_relaxed);
+
+#if defined(BUILD_LINKED_FREE_LIST)
 	freeTaskNodeList.push(first);
+#else
+	// the ring has a cell for every block, it can not be full
+	Bool pushed = freeTaskNodeList.push(first);
+	ASSERT(pushed);
+	(void)pushed;
+#endif
+}
+
+Bool LockFreeTaskNodeAllocator::Grow()
+{
+	U32 count = taskNodeCount.load(std::memory_order_acquire);
+
+	if (count == maxTaskNodeCount)
+		return 0;
+
+	growLock.lock();
+
+	// somebody else grew the pool while we waited, let the caller retry the free list first
+	if (taskNodeCount.load(std::memory_order_relaxed) != count || count == maxTaskNodeCount)
+	{
+		growLock.unlock();
+		return count != maxTaskNodeCount;
+	}
+
+	U32 slabSize = growBlockCount * blockSize;
+	LockFreeTaskNode* slab = taskNodes + count;
+
+	// commit whole pages, the neighbouring slabs may share the first and last page
+	UPtr pageSize = PageSize();
+	UPtr commitBegin = (UPtr)slab & ~(pageSize - 1);
+	UPtr commitEnd = ((UPtr)(slab + slabSize) + pageSize - 1) & ~(pageSize - 1);
+
+	if (!CommitBytes((void*)commitBegin, commitEnd - commitBegin))
+	{
+		growLock.unlock();
+		return 0;
+	}
+
+	for (U32 i = 0; i < slabSize; i++)
+	{
+		LockFreeTaskNode* node = new (slab + i) LockFreeTaskNode();
+
+		if (((i + 1) % blockSize) == 0)
+			node->freeNext = UINT32_MAX;
+		else
+			node->freeNext = count + i + 1;
+	}
+
+	taskNodeCount.store(count + slabSize, std::memory_order_release);
+
+	// the blocks start out as used, Push hands them to the free list
+	usedBlockCount.fetch_add(growBlockCount, std::memory_order_relaxed);
+
+	for (U32 i = 0; i < slabSize; i += blockSize)
+		Push(count + i, count + i + blockSize - 1);
+
+	growLock.unlock();
+	return 1;
+}
+
+U32 LockFreeTaskNodeAllocator::HighWaterMark()
+{
+	return maxUsedBlockCount.load(std::memory_order_relaxed) * blockSize;
 }
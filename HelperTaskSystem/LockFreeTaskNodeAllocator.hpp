@@ -22,25 +22,49 @@
 * SOFTWARE.
 **************************************************************************************************/
 
+
 #pragma once
 
 #include "Core.hpp"
 #include "LockFreeTaskNodeQueue.hpp"
+#include "LockFreeRingTaskNodeQueue.hpp"
 
+// Hands out blocks of blockSize task nodes. The address range for maxTaskNodeCount nodes is reserved
+// up front and committed one slab of growBlockCount blocks at a time, so node indices and pointers
+// stay valid while the pool grows and generations survive recycling. The free blocks are kept in a
+// ring sized for every block the pool can ever hold, BUILD_LINKED_FREE_LIST switches back to the
+// linked list queue.
 class LockFreeTaskNodeAllocator
 {
 public:
 
-	U32 taskNodeCount;
+	LockFreeTaskNode* taskNodes;
+	std::atomic<U32> taskNodeCount;
+	U32 maxTaskNodeCount;
 	U32 blockSize;
+	U32 growBlockCount;
+	SpinLock growLock;
+	std::atomic<U32> usedBlockCount;
+	std::atomic<U32> maxUsedBlockCount;
+#if defined(BUILD_LINKED_FREE_LIST)
 	LockFreeTaskNodeQueue freeTaskNodeList;
+#else
+	LockFreeRingTaskNodeQueue freeTaskNodeList;
+#endif
 
-	LockFreeTaskNodeAllocator(U32 blockCount = 0, U32 blockSize = 0);
+	LockFreeTaskNodeAllocator(U32 blockCount = 0, U32 blockSize = 0, U32 maxTaskNodeCount = 0);
 	~LockFreeTaskNodeAllocator();
 
-	void Initialize(U32 blockCount, U32 blockSize);
+	// maxTaskNodeCount is rounded up to whole slabs, 0 disables growing
+	void Initialize(U32 blockCount, U32 blockSize, U32 maxTaskNodeCount = 0);
 	void Destroy();
 
 	U32 TryPop();
 	void Push(U32 first, U32 last);
-};
\ No newline at end of file
+
+	// Commit the next slab, return 0 once maxTaskNodeCount is reached.
+	Bool Grow();
+
+	// Most task nodes that were out of the free list at the same time, in whole blocks.
+	U32 HighWaterMark();
+};
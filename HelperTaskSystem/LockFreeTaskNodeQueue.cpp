@@ -91,7 +91,7 @@ U32 LockFreeTaskNodeQueue::tryPop()
 			}
 			else
 			{
-				while ((tmp = taskNodes[first].next.load(std::memory_order_acquire)) == -1);
+				while ((tmp = taskNodes[first].next.load(std::memory_order_acquire)) == UINT32_MAX);
 
 				list.first.store(tmp, std::memory_order_release);
 				return first;
@@ -104,67 +104,3 @@ Bool LockFreeTaskNodeQueue::IsEmpty()
 {
 	return list.first.load(std::memory_order_relaxed) == UINT32_MAX;
 }
-
-LockFreeMPSCTaskNodeQueue::LockFreeMPSCTaskNodeQueue(LockFreeTaskNode* taskNodes)
-	: list(), taskNodes(taskNodes)
-{
-}
-
-U32 LockFreeMPSCTaskNodeQueue::push(U32 index)
-{
-	taskNodes[index].next.store(UINT32_MAX, std::memory_order_relaxed);
-
-	U32 last = list.last.exchange(index);
-
-	if (last != UINT32_MAX)
-	{
-		taskNodes[last].next.store(index, std::memory_order_release);
-		return 0;
-	}
-
-	U32 tmp;
-	while (!list.first.compare_exchange_weak(tmp = UINT32_MAX, index))
-		while (list.first.load(std::memory_order_acquire) != UINT32_MAX);
-
-	return 1;
-}
-
-U32 LockFreeMPSCTaskNodeQueue::tryPop()
-{
-	U32 tmp, first = list.first.load(std::memory_order_acquire);
-
-	while (true)
-	{
-		if (first == UINT32_MAX)
-			return UINT32_MAX;
-
-		tmp = taskNodes[first].next.load(std::memory_order_acquire);
-
-		if (tmp != UINT32_MAX)
-		{
-			list.first.store(tmp, std::memory_order_release);
-			return first;
-		}
-		else
-		{
-			U32 last = first;
-			if (list.last.compare_exchange_strong(last, tmp))
-			{
-				list.first.store(tmp, std::memory_order_release);
-				return first;
-			}
-			else
-			{
-				while ((tmp = taskNodes[first].next.load(std::memory_order_acquire)) == -1);
-
-				list.first.store(tmp, std::memory_order_release);
-				return first;
-			}
-		}
-	}
-}
-
-Bool LockFreeMPSCTaskNodeQueue::IsEmpty()
-{
-	return list.first.load(std::memory_order_relaxed) == UINT32_MAX;
-}
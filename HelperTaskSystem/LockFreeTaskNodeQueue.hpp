@@ -40,22 +40,5 @@ public:
 
 	U32 tryPop();
 
-	Bool IsEmpty();
-};
-
-class LockFreeMPSCTaskNodeQueue
-{
-public:
-
-	SafeList list;
-	LockFreeTaskNode* taskNodes;
-
-	LockFreeMPSCTaskNodeQueue(LockFreeTaskNode* taskNodes = (LockFreeTaskNode*)nullptr);
-
-	// return 1 if queue was empty
-	U32 push(U32 index);
-
-	U32 tryPop();
-
 	Bool IsEmpty();
 };
\ No newline at end of file
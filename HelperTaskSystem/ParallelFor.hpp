@@ -0,0 +1,303 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+#pragma once
+
+#include "WorkerBase.hpp"
+
+#if defined(CPP_HAS_EXCEPTIONS)
+#include <exception>
+#include <stdexcept>
+#endif
+
+/**
+* ParallelFor / ParallelReduce
+* 
+* The calling worker runs the whole range itself and only splits off the upper half of what is
+* left when WorkerBase::ShouldSplit reports an idle worker. Small ranges therefore cost about as
+* much as a serial loop while large ranges get split until every worker is busy.
+* 
+* Split off ranges are children of a join task that the caller waits on. The join task is only
+* created on the first split, which is always done by the caller. Every later split happens inside
+* the caller or a running child of the join task, so the join task cannot finish in between.
+* 
+* When map or body throws, the other ranges stop at their next grain and ranges that did not start
+* are canceled. The caller still waits for the join task before it throws the first exception
+* again, split off ranges point into its stack frame.
+* 
+* The join task takes the priority and CancellationToken of the calling task. Once the caller is
+* canceled or its tree fails all ranges stop at their next grain as well, the result then only
+* covers what ran and the caller checks WorkerBase::IsCanceled afterwards.
+*/
+
+template <class T, class Map, class Combine>
+struct ParallelReduceData;
+
+// Every split off range is linked into ParallelReduceData::ranges when it is created, the caller
+// frees them all after the join task, also those that were canceled before they ran.
+template <class T, class Map, class Combine>
+struct ParallelReduceRange
+{
+	ParallelReduceData<T, Map, Combine>* data;
+	I64 begin;
+	I64 end;
+	T result;
+	Bool finished;
+#if defined(CPP_HAS_EXCEPTIONS)
+	std::exception_ptr exception;
+#endif
+	ParallelReduceRange* next;
+};
+
+template <class T, class Map, class Combine>
+struct ParallelReduceData
+{
+	const Map* map;
+	const Combine* combine;
+	T identity;
+	I64 grain;
+	TaskHandle join;
+	std::atomic<Bool> stop;
+	std::atomic<ParallelReduceRange<T, Map, Combine>*> ranges;
+};
+
+template <class T, class Map, class Combine>
+T ParallelReduceRun(WorkerBase* worker, ParallelReduceData<T, Map, Combine>* data, I64 begin, I64 end);
+
+template <class T, class Map, class Combine>
+void ParallelReduceTask(WorkerBase* worker, void* args)
+{
+	typedef ParallelReduceRange<T, Map, Combine> Range;
+
+	Range* range = (Range*)args;
+
+#if defined(CPP_HAS_EXCEPTIONS)
+	try
+	{
+		range->result = ParallelReduceRun(worker, range->data, range->begin, range->end);
+	}
+	catch (...)
+	{
+		// the caller throws it again, throwing here fails the join task and cancels the rest
+		range->data->stop.store(1, std::memory_order_relaxed);
+		range->exception = std::current_exception();
+		throw;
+	}
+#else
+	range->result = ParallelReduceRun(worker, range->data, range->begin, range->end);
+#endif
+
+	range->finished = 1;
+}
+
+template <class T, class Map, class Combine>
+T ParallelReduceRun(WorkerBase* worker, ParallelReduceData<T, Map, Combine>* data, I64 begin, I64 end)
+{
+	typedef ParallelReduceRange<T, Map, Combine> Range;
+
+	T result = data->identity;
+
+	while (begin < end && data->stop.load(std::memory_order_relaxed) == 0)
+	{
+		if (end - begin >= data->grain * 2 && worker->ShouldSplit())
+		{
+			I64 middle = begin + (end - begin) / 2;
+			if (data->join.index == UINT32_MAX)
+			{
+				// the join stays out of the caller's tree, a range that throws would fail it even when
+				// the caller catches. The ranges still run with the caller's priority and token.
+				data->join = worker->NewTask((TaskFunction)nullptr, nullptr, TaskHandle(), TaskHandle());
+
+				TaskHandle caller = worker->CurrentTask();
+				if (caller.index != UINT32_MAX)
+				{
+					worker->SetPriority(data->join, worker->GetPriority(caller));
+					worker->SetCancellationToken(data->join, worker->GetCancellationToken(caller));
+				}
+			}
+
+			Range* range = new Range();
+			range->data = data;
+			range->begin = middle;
+			range->end = end;
+			range->finished = 0;
+
+			range->next = data->ranges.load(std::memory_order_relaxed);
+			while (!data->ranges.compare_exchange_weak(range->next, range, std::memory_order_release,
+				std::memory_order_relaxed));
+
+			worker->SubmitTask(worker->NewTask(&ParallelReduceTask<T, Map, Combine>, range, TaskHandle(),
+				data->join));
+
+			end = middle;
+			continue;
+		}
+
+		// the caller sees failures of its own tree, the ranges only see the join and the token
+		if (worker->IsCanceled())
+		{
+			data->stop.store(1, std::memory_order_relaxed);
+			break;
+		}
+
+		I64 chunkEnd = end - begin > data->grain ? begin + data->grain : end;
+
+		for (; begin < chunkEnd; begin++)
+			result = (*data->combine)(result, (*data->map)(begin));
+	}
+
+	return result;
+}
+
+// Wait for the split off ranges, combine the results of those that finished into result and free
+// them all. Throws the first exception of a range if the join task failed.
+template <class T, class Map, class Combine>
+T ParallelReduceJoin(WorkerBase* worker, ParallelReduceData<T, Map, Combine>* data, T result)
+{
+	typedef ParallelReduceRange<T, Map, Combine> Range;
+
+	if (data->join.index == UINT32_MAX)
+		return result;
+
+	worker->SubmitTask(data->join);
+	U32 joinResult = worker->WaitOnTask(data->join);
+
+#if defined(CPP_HAS_EXCEPTIONS)
+	std::exception_ptr exception;
+#endif
+
+	Range* range = data->ranges.load(std::memory_order_acquire);
+
+	while (range != nullptr)
+	{
+		Range* next = range->next;
+
+		if (range->finished)
+			result = (*data->combine)(result, range->result);
+
+#if defined(CPP_HAS_EXCEPTIONS)
+		if (range->exception && !exception)
+			exception = range->exception;
+#endif
+
+		delete range;
+		range = next;
+	}
+
+#if defined(CPP_HAS_EXCEPTIONS)
+	// a task map spawned below a range failed, there is no exception to hand on
+	if (joinResult == TaskResult::TRFailed)
+	{
+		if (exception)
+			std::rethrow_exception(exception);
+
+		throw std::runtime_error("ParallelReduce: a task below a range failed");
+	}
+#else
+	(void)joinResult;
+#endif
+
+	return result;
+}
+
+// Returns identity combined with map(i) for every i in [begin, end). Partial results are combined
+// in no particular order, combine must be associative and commutative.
+template <class T, class Map, class Combine>
+T ParallelReduce(WorkerBase* worker, I64 begin, I64 end, I64 grain, T identity, const Map& map,
+	const Combine& combine)
+{
+	typedef ParallelReduceRange<T, Map, Combine> Range;
+
+	if (grain < 1)
+		grain = 1;
+
+	ParallelReduceData<T, Map, Combine> data;
+	data.map = &map;
+	data.combine = &combine;
+	data.identity = identity;
+	data.grain = grain;
+	data.join = TaskHandle();
+	data.stop.store(0, std::memory_order_relaxed);
+	data.ranges.store((Range*)nullptr, std::memory_order_relaxed);
+
+#if defined(CPP_HAS_EXCEPTIONS)
+	T result = identity;
+
+	try
+	{
+		result = ParallelReduceRun(worker, &data, begin, end);
+	}
+	catch (...)
+	{
+		// split off ranges point at data, they have to finish before it goes away, our exception
+		// wins over theirs
+		data.stop.store(1, std::memory_order_relaxed);
+
+		try
+		{
+			(void)ParallelReduceJoin(worker, &data, identity);
+		}
+		catch (...)
+		{
+		}
+
+		throw;
+	}
+#else
+	T result = ParallelReduceRun(worker, &data, begin, end);
+#endif
+
+	return ParallelReduceJoin(worker, &data, result);
+}
+
+template <class Body>
+struct ParallelForMap
+{
+	const Body* body;
+
+	Bool operator()(I64 i) const
+	{
+		(*body)(i);
+		return 0;
+	}
+};
+
+struct ParallelForCombine
+{
+	Bool operator()(Bool, Bool) const
+	{
+		return 0;
+	}
+};
+
+// Calls body(i) for every i in [begin, end), grain is the smallest range that gets split off.
+template <class Body>
+void ParallelFor(WorkerBase* worker, I64 begin, I64 end, I64 grain, const Body& body)
+{
+	ParallelForMap<Body> map;
+	map.body = &body;
+
+	(void)ParallelReduce(worker, begin, end, grain, (Bool)0, map, ParallelForCombine());
+}
@@ -342,6 +342,10 @@
 #define noexcept throw()
 #endif
 
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+#define CPP_HAS_EXCEPTIONS 1
+#endif
+
 
 
 /**
@@ -379,6 +383,11 @@
 #include <string.h>
 #include <new>
 
+#if COMPILER_MSVC
+#include <malloc.h>
+#include <intrin.h>
+#endif
+
 #if !defined(BUILD_DEBUG)
 #define NDEBUG
 #endif
@@ -485,4 +494,57 @@ inline void* AllocateBytes(UPtr count)
 inline void Free(void* memory)
 {
 	free(memory);
+}
+
+inline void* AllocateAlignedBytes(UPtr count, UPtr alignment)
+{
+#if COMPILER_MSVC
+	return _aligned_malloc(count, alignment);
+#else
+	void* memory;
+	return posix_memalign(&memory, alignment, count) == 0 ? memory : nullptr;
+#endif
+}
+
+inline void FreeAligned(void* memory)
+{
+#if COMPILER_MSVC
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
+
+// Tell the cpu we are busy waiting, saves power and leaves the core to the sibling hyper thread
+inline void CpuPause()
+{
+#if COMPILER_MSVC && (ARCHITECTURE_X64 || ARCHITECTURE_X86)
+	_mm_pause();
+#elif COMPILER_MSVC
+	__yield();
+#elif ARCHITECTURE_X64 || ARCHITECTURE_X86
+	__builtin_ia32_pause();
+#else
+	__asm__ __volatile__("yield");
+#endif
+}
+
+// Index of the lowest set bit, value must not be 0
+inline U32 CountTrailingZeros(U64 value)
+{
+#if COMPILER_MSVC && ARCHITECTURE_X64
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return (U32)index;
+#elif COMPILER_MSVC
+	unsigned long index;
+
+	if (_BitScanForward(&index, (unsigned long)value))
+		return (U32)index;
+
+	_BitScanForward(&index, (unsigned long)(value >> 32));
+	return (U32)index + 32;
+#else
+	return (U32)__builtin_ctzll(value);
+#endif
 }
\ No newline at end of file
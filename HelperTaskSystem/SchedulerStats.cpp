@@ -0,0 +1,111 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+#include "SchedulerStats.hpp"
+
+WorkerStats::WorkerStats()
+	: counters()
+{
+}
+
+const char* WorkerStats::Name(U32 counter)
+{
+	static const char* names[WSCount] =
+	{
+		"tasks executed",
+		"steals attempted",
+		"steals succeeded",
+		"tasks stolen",
+		"deque growths",
+		"sleeps",
+		"wakes requested",
+		"spin ns",
+	};
+
+	return names[counter];
+}
+
+TraceRing::TraceRing()
+	: events((TraceEvent*)nullptr),
+	mask(0),
+	head(0)
+{
+}
+
+TraceRing::~TraceRing()
+{
+	Destroy();
+}
+
+void TraceRing::Initialize(U32 capacity)
+{
+	if (capacity == 0)
+		return;
+
+	U32 size = 1;
+	while (size < capacity)
+		size <<= 1;
+
+	events = Allocate<TraceEvent>(size);
+	mask = size - 1;
+	head.store(0, std::memory_order_relaxed);
+}
+
+void TraceRing::Destroy()
+{
+	if (events != nullptr)
+		Free(events);
+
+	events = (TraceEvent*)nullptr;
+}
+
+U32 TraceRing::WriteChromeTrace(FILE* file, U32 tid, Bool first)
+{
+	static const char* phases[] = { "B", "E", "i", "i" };
+	static const char* names[] = { "task", "task", "sleep", "wake" };
+
+	if (events == nullptr)
+		return 0;
+
+	U64 end = head.load(std::memory_order_acquire);
+	U64 begin = end > mask + 1 ? end - (mask + 1) : 0;
+	U32 written = 0;
+
+	for (U64 i = begin; i < end; i++)
+	{
+		const TraceEvent& event = events[i & mask];
+
+		// the oldest task may have lost its begin event to the ring wrapping around
+		if (written == 0 && event.type == TraceEvent::TEEnd)
+			continue;
+
+		fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":0,\"tid\":%u,\"args\":{\"task\":%u}}",
+			first && written == 0 ? "\n" : ",\n", names[event.type], phases[event.type], (F64)event.time / 1000.0,
+			tid, event.task);
+		written++;
+	}
+
+	return written;
+}
@@ -0,0 +1,127 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+#pragma once
+
+#include <stdio.h>
+#include "Core.hpp"
+
+/**
+* Scheduler instrumentation
+* 
+* Define BUILD_SCHEDULER_STATS to count scheduler events per worker and BUILD_SCHEDULER_TRACE to
+* record task begin and end into a ring per worker, which can be written out as Chrome trace JSON
+* (chrome://tracing or ui.perfetto.dev). Without them the members are left out and the macros
+* compile to nothing.
+*/
+
+#if defined(BUILD_SCHEDULER_STATS)
+#define WORKER_STAT(worker, counter, amount) (worker)->stats.Add(WorkerStats::counter, (U64)(amount))
+#else
+#define WORKER_STAT(worker, counter, amount) ((void)0)
+#endif
+
+#if defined(BUILD_SCHEDULER_TRACE)
+#define WORKER_TRACE(worker, type, task) (worker)->trace.Record(TraceEvent::type, task)
+#else
+#define WORKER_TRACE(worker, type, task) ((void)0)
+#endif
+
+// Only the owning worker writes, any thread may read. Cache line aligned per worker.
+struct CACHE_ALIGN WorkerStats
+{
+	enum
+	{
+		WSTasksExecuted,
+		WSStealsAttempted,
+		WSStealsSucceeded,
+		WSTasksStolen,
+		WSDequeGrowths,
+		WSSleeps,
+		WSWakesRequested,
+		WSSpinNanoseconds,
+		WSCount,
+	};
+
+	std::atomic<U64> counters[WSCount];
+
+	WorkerStats();
+
+	void Add(U32 counter, U64 amount)
+	{
+		counters[counter].store(counters[counter].load(std::memory_order_relaxed) + amount,
+			std::memory_order_relaxed);
+	}
+
+	U64 Get(U32 counter) const { return counters[counter].load(std::memory_order_relaxed); }
+
+	static const char* Name(U32 counter);
+};
+
+struct TraceEvent
+{
+	enum
+	{
+		TEBegin,
+		TEEnd,
+		TESleep,
+		TEWake,
+	};
+
+	I64 time;
+	U32 task;
+	U32 type;
+};
+
+// Single producer ring that keeps the newest events. Read it while the owner is idle, events being
+// overwritten during a read may come out torn.
+class TraceRing
+{
+public:
+
+	TraceEvent* events;
+	U64 mask;
+	std::atomic<U64> head;
+
+	TraceRing();
+	~TraceRing();
+
+	// capacity is rounded up to a power of two
+	void Initialize(U32 capacity);
+	void Destroy();
+
+	void Record(U32 type, U32 task)
+	{
+		U64 tmp = head.load(std::memory_order_relaxed);
+		TraceEvent& event = events[tmp & mask];
+		event.time = Clock::now().time_since_epoch().count();
+		event.task = task;
+		event.type = type;
+		head.store(tmp + 1, std::memory_order_release);
+	}
+
+	// Append the events as Chrome trace JSON objects of thread tid, return the number written.
+	U32 WriteChromeTrace(FILE* file, U32 tid, Bool first);
+};
@@ -0,0 +1,101 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+#include "SmallBlockCache.hpp"
+
+enum
+{
+	BlockClassCount = 7,
+	BlockCacheLimit = 0x100,
+};
+
+// Free blocks are linked through their first bytes.
+struct SmallBlockCache
+{
+	void* lists[BlockClassCount];
+	U32 counts[BlockClassCount];
+
+	SmallBlockCache() : lists(), counts() {}
+
+	~SmallBlockCache()
+	{
+		for (U32 i = 0; i < BlockClassCount; i++)
+		{
+			while (lists[i] != nullptr)
+			{
+				void* block = lists[i];
+				lists[i] = *(void**)block;
+				FreeAligned(block);
+			}
+		}
+	}
+};
+
+static thread_local SmallBlockCache blockCache;
+
+static U32 BlockClass(UPtr size)
+{
+	U32 blockClass = 0;
+
+	while (((UPtr)64 << blockClass) < size)
+		blockClass++;
+
+	return blockClass;
+}
+
+void* AllocateSmallBlock(UPtr size)
+{
+	U32 blockClass = BlockClass(size);
+
+	if (blockClass >= BlockClassCount)
+		return AllocateAlignedBytes(size, CACHE_LINE);
+
+	SmallBlockCache& cache = blockCache;
+	void* block = cache.lists[blockClass];
+
+	if (block == nullptr)
+		return AllocateAlignedBytes((UPtr)64 << blockClass, CACHE_LINE);
+
+	cache.lists[blockClass] = *(void**)block;
+	cache.counts[blockClass]--;
+	return block;
+}
+
+void FreeSmallBlock(void* block, UPtr size)
+{
+	U32 blockClass = BlockClass(size);
+	SmallBlockCache& cache = blockCache;
+
+	// blocks freed by other threads end up in their caches, keep those from growing forever
+	if (blockClass >= BlockClassCount || cache.counts[blockClass] == BlockCacheLimit)
+	{
+		FreeAligned(block);
+		return;
+	}
+
+	*(void**)block = cache.lists[blockClass];
+	cache.lists[blockClass] = block;
+	cache.counts[blockClass]++;
+}
@@ -24,8 +24,6 @@
 
 #include "SpinLock.hpp"
 
-#include <Windows.h>
-
 SpinLock::SpinLock()
 	: flag(0)
 {
@@ -0,0 +1,141 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+#include "TaskArena.hpp"
+
+static Byte* ChunkData(TaskArenaChunk* chunk)
+{
+	return (Byte*)chunk + CACHE_LINE;
+}
+
+TaskArena::TaskArena()
+	: first((TaskArenaChunk*)nullptr),
+	current((TaskArenaChunk*)nullptr),
+	used(0)
+{
+}
+
+TaskArena::~TaskArena()
+{
+	Destroy();
+}
+
+void* TaskArena::Allocate(UPtr size, UPtr alignment)
+{
+	if (current != nullptr)
+	{
+		UPtr address = (UPtr)ChunkData(current) + used;
+		UPtr aligned = (address + alignment - 1) & ~(alignment - 1);
+
+		if (aligned - (UPtr)ChunkData(current) + size <= current->size)
+		{
+			used = aligned - (UPtr)ChunkData(current) + size;
+			return (void*)aligned;
+		}
+	}
+
+	// chunk data is cache line aligned, only larger alignments need room to move
+	UPtr needed = size + (alignment > CACHE_LINE ? alignment - CACHE_LINE : 0);
+	TaskArenaChunk* next = current != nullptr ? current->next : first;
+
+	if (next == nullptr || next->size < needed)
+	{
+		UPtr chunkSize = needed > ChunkSize ? needed : (UPtr)ChunkSize;
+		TaskArenaChunk* chunk = (TaskArenaChunk*)AllocateAlignedBytes(CACHE_LINE + chunkSize, CACHE_LINE);
+
+		if (chunk == nullptr)
+			return nullptr;
+
+		chunk->next = next;
+		chunk->size = chunkSize;
+
+		if (current != nullptr)
+			current->next = chunk;
+		else
+			first = chunk;
+
+		next = chunk;
+	}
+
+	UPtr address = (UPtr)ChunkData(next);
+	UPtr aligned = (address + alignment - 1) & ~(alignment - 1);
+
+	current = next;
+	used = aligned - address + size;
+	return (void*)aligned;
+}
+
+TaskArenaMark TaskArena::Mark()
+{
+	TaskArenaMark mark;
+	mark.chunk = current;
+	mark.used = used;
+	return mark;
+}
+
+void TaskArena::Reset(TaskArenaMark mark)
+{
+	if (mark.chunk != current)
+	{
+		// oversized chunks only ever sit between first and current, the spares behind current
+		// all have ChunkSize bytes
+		TaskArenaChunk** link = mark.chunk != nullptr ? &mark.chunk->next : &first;
+		TaskArenaChunk* last = current;
+
+		for (;;)
+		{
+			TaskArenaChunk* chunk = *link;
+
+			if (chunk->size > ChunkSize)
+			{
+				*link = chunk->next;
+				FreeAligned(chunk);
+			}
+			else
+			{
+				link = &chunk->next;
+			}
+
+			if (chunk == last)
+				break;
+		}
+	}
+
+	current = mark.chunk;
+	used = mark.used;
+}
+
+void TaskArena::Destroy()
+{
+	while (first != nullptr)
+	{
+		TaskArenaChunk* next = first->next;
+		FreeAligned(first);
+		first = next;
+	}
+
+	current = (TaskArenaChunk*)nullptr;
+	used = 0;
+}
@@ -0,0 +1,74 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+
+#pragma once
+
+#include "Core.hpp"
+
+// Header of an arena chunk, the memory handed out starts CACHE_LINE bytes after it.
+struct TaskArenaChunk
+{
+	TaskArenaChunk* next;
+	UPtr size;
+};
+
+// Position of an arena, Reset hands everything allocated after it back.
+struct TaskArenaMark
+{
+	TaskArenaChunk* chunk;
+	UPtr used;
+};
+
+// Bump allocator for the scratch memory of the tasks a worker runs. Chunks are allocated on first
+// use by the thread that runs the tasks and kept, a reset only moves back the bump pointer.
+// Chunks larger than ChunkSize for oversized requests go back to the heap once a reset drops
+// below them. Only the thread owning the worker may use it.
+class TaskArena
+{
+public:
+
+	enum { ChunkSize = 0x10000 };
+
+	TaskArenaChunk* first;
+	TaskArenaChunk* current;
+	UPtr used;
+
+	TaskArena();
+	~TaskArena();
+
+	// alignment is a power of two
+	void* Allocate(UPtr size, UPtr alignment);
+
+	TaskArenaMark Mark();
+
+	// mark comes from Mark and no reset to an earlier mark happened since
+	void Reset(TaskArenaMark mark);
+
+	void Destroy();
+
+	TaskArena(const TaskArena& other) = delete;
+	TaskArena& operator=(const TaskArena& other) = delete;
+};
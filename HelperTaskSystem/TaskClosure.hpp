@@ -0,0 +1,90 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+#pragma once
+
+#include <type_traits>
+#include <utility>
+#include "WorkerBase.hpp"
+#include "SmallBlockCache.hpp"
+
+/**
+* NewTask(worker, closure)
+* 
+* Creates a task running closure(worker). Closures up to TaskStorage::Size bytes are constructed
+* inside the task node, larger ones in a small block of the creating thread. Either way the closure
+* is destroyed once the task and all of its children finished, so children may keep pointers into
+* its captures.
+*/
+
+template <class Closure>
+void TaskClosureRun(WorkerBase* worker, void* storage)
+{
+	(*(Closure*)storage)(worker);
+}
+
+template <class Closure>
+void TaskClosureDestroy(void* storage)
+{
+	((Closure*)storage)->~Closure();
+}
+
+template <class Closure>
+void TaskClosureRunIndirect(WorkerBase* worker, void* storage)
+{
+	(**(Closure**)storage)(worker);
+}
+
+template <class Closure>
+void TaskClosureDestroyIndirect(void* storage)
+{
+	Closure* closure = *(Closure**)storage;
+	closure->~Closure();
+	FreeSmallBlock(closure, sizeof(Closure));
+}
+
+template <class F>
+TaskHandle NewTask(
+	WorkerBase*	worker,
+	F&&			closure,
+	TaskHandle	dependency = TaskHandle(),
+	TaskHandle	parent = TaskHandle()
+)
+{
+	typedef typename std::decay<F>::type Closure;
+	static_assert(alignof(Closure) <= CACHE_LINE, "closure alignment exceeds the task storage alignment");
+
+	if (sizeof(Closure) <= TaskStorage::Size)
+	{
+		TaskHandle task = worker->NewTask(&TaskClosureRun<Closure>, nullptr, dependency, parent);
+		new (worker->AttachStorage(task, &TaskClosureDestroy<Closure>)) Closure(std::forward<F>(closure));
+		return task;
+	}
+
+	TaskHandle task = worker->NewTask(&TaskClosureRunIndirect<Closure>, nullptr, dependency, parent);
+	Closure* indirect = new (AllocateSmallBlock(sizeof(Closure))) Closure(std::forward<F>(closure));
+	*(Closure**)worker->AttachStorage(task, &TaskClosureDestroyIndirect<Closure>) = indirect;
+	return task;
+}
@@ -25,16 +25,73 @@
 #pragma once
 
 #include "Core.hpp"
+#include "CancellationToken.hpp"
 
 typedef void (*TaskFunction)(class WorkerBase*, void*);
+typedef void (*TaskStorageDestructor)(void*);
+typedef Bool (*TaskPredicate)(void*);
 
+// The low bits of Task::flags hold the TaskPriority. TFStorage marks tasks whose node storage
+// holds a closure that is destroyed once the task finished, TFToken tasks whose node storage points
+// to a CancellationToken. TFWaiter marks successor nodes of a WaitOnTask call, their args point to
+// the Futex of the waiter.
 struct TaskFlags
 {
 	enum
 	{
 		TFNone = 0,
-		TFQuit = 0xFFFF,
+		TFPriorityMask = 0x3,
+		TFStorage = 0x4,
+		TFToken = 0x8,
+		TFWaiter = 0x10,
+		TFQuit = 0x8000,
 	};
+
+	static U32 Priority(U32 flags) { return flags & TFPriorityMask; }
+};
+
+// Workers drain high before normal before background, every BackgroundInterval tasks a worker
+// looks at the background tier first so it can not starve under a saturating load.
+struct TaskPriority
+{
+	enum
+	{
+		TPNormal = 0,
+		TPHigh = 1,
+		TPBackground = 2,
+		TPCount = 3,
+		BackgroundInterval = 0x40,
+	};
+};
+
+// Outcome of a task, the worse one wins when results are merged. A task fails when its function
+// throws and marks all of its ancestors failed, descendants that did not start yet when an ancestor
+// was marked failed are canceled, and so are tasks whose CancellationToken was canceled. Canceled
+// children mark their parent canceled when they finish. A finished task leaves its result in the
+// low TRBits of the generation of its node, so it can still be read through a stale handle until
+// the next task on the node finished.
+struct TaskResult
+{
+	enum
+	{
+		TROk = 0,
+		TRCanceled = 1,
+		TRFailed = 2,
+		TRBits = 2,
+		TRMask = (1 << TRBits) - 1,
+	};
+
+	static U32 NextGeneration(U32 generation, U32 result) { return (((generation >> TRBits) + 1) << TRBits) | result; }
+
+	// Result of the task with generation once the node moved on to nodeGeneration, TROk if the
+	// node has been through another finished task since.
+	static U32 Get(U32 generation, U32 nodeGeneration)
+	{
+		if ((((nodeGeneration >> TRBits) - (generation >> TRBits)) & (UINT32_MAX >> TRBits)) != 1)
+			return TROk;
+
+		return nodeGeneration & TRMask;
+	}
 };
 
 struct TaskHandle
@@ -46,32 +103,81 @@ struct TaskHandle
 	TaskHandle(U32 index, U32 generation) : index(index), generation(generation) {}
 };
 
+// Refers to a pending timer, the generation moves on once it fired for the last time or got
+// canceled.
+struct TimerHandle
+{
+	U32 index;
+	U32 generation;
+
+	TimerHandle() : index(UINT32_MAX), generation(UINT32_MAX) {}
+	TimerHandle(U32 index, U32 generation) : index(index), generation(generation) {}
+};
+
+// Successor lists pack the generation of the task they belong to with the index of the first
+// successor node, so a stale handle can never add a successor to a recycled node.
+struct TaskSuccessors
+{
+	enum
+	{
+		TSEmpty = UINT32_MAX,
+		TSClosed = UINT32_MAX - 1,
+	};
+
+	static U64 Pack(U32 generation, U32 first) { return ((U64)generation << 32) | first; }
+	static U32 Generation(U64 successors) { return (U32)(successors >> 32); }
+	static U32 First(U64 successors) { return (U32)successors; }
+};
+
+// count holds the task itself plus its unfinished children. pending holds one reference for
+// the submission plus one per unfinished dependency, the task is queued when it reaches 0. result
+// holds the TaskResult of the task and its children so far.
+// Successor nodes are plain task nodes whose parent is the waiting task, linked through next.
 struct Task
 {
 	TaskFunction function;
 	void* args;
-	TaskHandle dependency;
 	TaskHandle parent;
 	U32 flags;
 	std::atomic<U32> count;
+	std::atomic<U32> pending;
+	std::atomic<U32> result;
+	std::atomic<U64> successors;
 
 	Task()
 		: function((TaskFunction)nullptr),
 		args(nullptr),
-		dependency(),
 		parent(),
+		flags(0),
 		count(0),
-		flags(0)
+		pending(0),
+		result(TaskResult::TROk),
+		successors(TaskSuccessors::Pack(0, TaskSuccessors::TSClosed))
 	{}
 };
 
+// Inline closure storage and cancellation token, they get a cache line of their own so tasks
+// without either never touch it.
+struct CACHE_ALIGN TaskStorage
+{
+	enum { Size = CACHE_LINE - sizeof(TaskStorageDestructor) - sizeof(CancellationToken*) };
+
+	Byte bytes[Size];
+	TaskStorageDestructor destroy;
+	CancellationToken* token;
+
+	TaskStorage() : bytes(), destroy((TaskStorageDestructor)nullptr), token((CancellationToken*)nullptr) {}
+};
+
 struct CACHE_ALIGN LockFreeTaskNode
 {
 	Task task;
 	std::atomic<U32> next;
 	std::atomic<U32> generation;
+	U32 freeNext;
+	TaskStorage storage;
 
-	LockFreeTaskNode() :task(), next(0), generation(0) {}
+	LockFreeTaskNode() :task(), next(0), generation(0), freeNext(UINT32_MAX), storage() {}
 };
 
 struct CACHE_ALIGN SafeList
@@ -0,0 +1,281 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+#include "TimerWheel.hpp"
+
+static U64 RotateRight(U64 value, U32 shift)
+{
+	return shift == 0 ? value : (value >> shift) | (value << (64 - shift));
+}
+
+TimerWheel::TimerWheel()
+	: lock(),
+	count(0),
+	keeper(UINT32_MAX),
+	freeEntries(UINT32_MAX),
+	keeperTick(UINT64_MAX),
+	currentTick(0),
+	start(Clock::now()),
+	occupied(),
+	slots(),
+	entries()
+{
+	for (U32 i = 0; i < LevelCount * SlotCount; i++)
+		slots[i] = UINT32_MAX;
+}
+
+void TimerWheel::Lock()
+{
+	for (U32 i = 0; !lock.try_lock(); i++)
+	{
+		if (i < 0x40)
+			CpuPause();
+		else
+			std::this_thread::yield();
+	}
+}
+
+void TimerWheel::Unlock()
+{
+	lock.unlock();
+}
+
+U64 TimerWheel::Now()
+{
+	return (U64)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+}
+
+U32 TimerWheel::MillisecondsUntil(U64 tick)
+{
+	I64 elapsed = std::chrono::nanoseconds(Clock::now() - start).count();
+	I64 remaining = (I64)tick * 1000000 - elapsed;
+
+	if (remaining <= 0)
+		return 0;
+
+	remaining = (remaining + 999999) / 1000000;
+	return remaining < (I64)UINT32_MAX ? (U32)remaining : UINT32_MAX - 1;
+}
+
+TimerHandle TimerWheel::Add(TaskFunction function, void* args, U32 delayMilliseconds, U32 periodMilliseconds)
+{
+	U32 index = freeEntries;
+
+	if (index != UINT32_MAX)
+	{
+		freeEntries = entries[index].next;
+	}
+	else
+	{
+		index = (U32)entries.size();
+
+		TimerEntry entry;
+		entry.generation = 0;
+		entries.push_back(entry);
+	}
+
+	TimerEntry& timer = entries[index];
+	timer.function = function;
+	timer.args = args;
+	timer.period = periodMilliseconds;
+
+	// the current millisecond is partly over already, round up so the timer never fires early
+	I64 elapsed = std::chrono::nanoseconds(Clock::now() - start).count();
+	timer.deadline = (U64)((elapsed + 999999) / 1000000) + delayMilliseconds;
+
+	if (timer.deadline <= currentTick)
+		timer.deadline = currentTick + 1;
+
+	Link(index);
+	count.fetch_add(1, std::memory_order_relaxed);
+
+	return TimerHandle(index, timer.generation);
+}
+
+Bool TimerWheel::Cancel(TimerHandle timer)
+{
+	if (timer.index >= entries.size())
+		return 0;
+
+	TimerEntry& entry = entries[timer.index];
+
+	if (entry.generation != timer.generation || entry.slot == UINT32_MAX)
+		return 0;
+
+	Unlink(timer.index);
+	Free(timer.index);
+	return 1;
+}
+
+U64 TimerWheel::NextTick()
+{
+	if (count.load(std::memory_order_relaxed) == 0)
+		return UINT64_MAX;
+
+	U64 next = UINT64_MAX;
+
+	// the first occupied slot after the current one, in the lowest level its timers are due then,
+	// in the others they move down then
+	for (U32 level = 0; level < LevelCount; level++)
+	{
+		if (occupied[level] == 0)
+			continue;
+
+		U64 window = (currentTick >> (SlotBits * level)) + 1;
+		U64 bits = RotateRight(occupied[level], (U32)(window & (SlotCount - 1)));
+		U64 tick = (window + CountTrailingZeros(bits)) << (SlotBits * level);
+
+		if (tick < next)
+			next = tick;
+	}
+
+	return next;
+}
+
+Bool TimerWheel::TryAdvance(U64 now, std::vector<TimerFire>& fired)
+{
+	if (!lock.try_lock())
+		return 0;
+
+	while (currentTick < now)
+	{
+		U64 tick = NextTick();
+
+		if (tick > now)
+		{
+			currentTick = now;
+			break;
+		}
+
+		currentTick = tick;
+
+		// higher levels first, their timers may move into a slot of a lower level that starts now
+		for (U32 level = LevelCount - 1; level != 0; level--)
+		{
+			if ((tick & (((U64)1 << (SlotBits * level)) - 1)) != 0)
+				continue;
+
+			U32 slot = level * SlotCount + (U32)((tick >> (SlotBits * level)) & (SlotCount - 1));
+			U32 index = slots[slot];
+			slots[slot] = UINT32_MAX;
+			occupied[level] &= ~((U64)1 << (slot & (SlotCount - 1)));
+
+			while (index != UINT32_MAX)
+			{
+				U32 next = entries[index].next;
+
+				// timers due right now land in the lowest level slot handled below
+				Link(index);
+				index = next;
+			}
+		}
+
+		U32 slot = (U32)(tick & (SlotCount - 1));
+		U32 index = slots[slot];
+		slots[slot] = UINT32_MAX;
+		occupied[0] &= ~((U64)1 << slot);
+
+		while (index != UINT32_MAX)
+		{
+			TimerEntry& timer = entries[index];
+			U32 next = timer.next;
+
+			TimerFire fire;
+			fire.function = timer.function;
+			fire.args = timer.args;
+			fired.push_back(fire);
+
+			if (timer.period != 0)
+			{
+				// a wheel that fell behind skips the periods it missed instead of firing them at once
+				timer.deadline += timer.period;
+
+				if (timer.deadline <= now)
+					timer.deadline += ((now - timer.deadline) / timer.period + 1) * timer.period;
+
+				Link(index);
+			}
+			else
+			{
+				timer.slot = UINT32_MAX;
+				Free(index);
+			}
+
+			index = next;
+		}
+	}
+
+	lock.unlock();
+	return 1;
+}
+
+void TimerWheel::Link(U32 index)
+{
+	TimerEntry& timer = entries[index];
+	U64 delta = timer.deadline - currentTick;
+	U32 level = 0;
+
+	while (level + 1 < LevelCount && delta >= (U64)1 << (SlotBits * (level + 1)))
+		level++;
+
+	U32 slot = level * SlotCount + (U32)((timer.deadline >> (SlotBits * level)) & (SlotCount - 1));
+
+	timer.slot = slot;
+	timer.prev = UINT32_MAX;
+	timer.next = slots[slot];
+
+	if (timer.next != UINT32_MAX)
+		entries[timer.next].prev = index;
+
+	slots[slot] = index;
+	occupied[level] |= (U64)1 << (slot & (SlotCount - 1));
+}
+
+void TimerWheel::Unlink(U32 index)
+{
+	TimerEntry& timer = entries[index];
+
+	if (timer.prev != UINT32_MAX)
+		entries[timer.prev].next = timer.next;
+	else
+		slots[timer.slot] = timer.next;
+
+	if (timer.next != UINT32_MAX)
+		entries[timer.next].prev = timer.prev;
+
+	if (slots[timer.slot] == UINT32_MAX)
+		occupied[timer.slot / SlotCount] &= ~((U64)1 << (timer.slot & (SlotCount - 1)));
+
+	timer.slot = UINT32_MAX;
+}
+
+void TimerWheel::Free(U32 index)
+{
+	TimerEntry& timer = entries[index];
+
+	timer.generation++;
+	timer.next = freeEntries;
+	freeEntries = index;
+	count.fetch_sub(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,114 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+#pragma once
+
+#include "SpinLock.hpp"
+#include "TaskData.hpp"
+
+struct TimerEntry
+{
+	TaskFunction function;
+	void* args;
+	U64 deadline;
+	U32 period;
+	U32 generation;
+	U32 next;
+	U32 prev;
+	U32 slot;
+};
+
+struct TimerFire
+{
+	TaskFunction function;
+	void* args;
+};
+
+// Hierarchical timing wheel with a tick of one millisecond. Every level has SlotCount slots and a
+// slot spans all slots of the level below, a timer sits in the lowest level whose range reaches its
+// deadline and moves down once the wheel reaches the start of its slot. The slots hold intrusive
+// doubly linked lists of entries, adding and canceling a timer is O(1). occupied has one bit per
+// non empty slot so the wheel can skip ahead to the next tick with something to do.
+//
+// keeper is the worker that parks with a timeout until keeperTick, UINT32_MAX if no worker does.
+// Everything but count is guarded by lock, count lets workers skip the wheel without timers.
+class TimerWheel
+{
+public:
+
+	enum
+	{
+		SlotBits = 6,
+		SlotCount = 1 << SlotBits,
+		// six levels reach 2^36 ms, more than any U32 delay
+		LevelCount = 6,
+		// busy workers look at the wheel every PollInterval tasks
+		PollInterval = 0x40,
+	};
+
+	SpinLock lock;
+	std::atomic<U32> count;
+	U32 keeper;
+	U32 freeEntries;
+	U64 keeperTick;
+	U64 currentTick;
+	TimePoint start;
+	U64 occupied[LevelCount];
+	U32 slots[LevelCount * SlotCount];
+	std::vector<TimerEntry> entries;
+
+	TimerWheel();
+
+	// Milliseconds since the wheel was created
+	U64 Now();
+
+	// Milliseconds until tick starts, rounded up so a park with this timeout never ends early
+	U32 MillisecondsUntil(U64 tick);
+
+	// The worker holding lock may be firing thousands of timers, waiters yield instead of spinning.
+	void Lock();
+	void Unlock();
+
+	// Add, Cancel and NextTick expect lock to be held. A timer fires after at least
+	// delayMilliseconds and then every periodMilliseconds until it is canceled, 0 fires once.
+	TimerHandle Add(TaskFunction function, void* args, U32 delayMilliseconds, U32 periodMilliseconds);
+
+	// Return 1 if timer was pending and will not fire anymore.
+	Bool Cancel(TimerHandle timer);
+
+	// First tick the wheel has something to do at, UINT64_MAX without timers.
+	U64 NextTick();
+
+	// Move the wheel up to now and append the timers that are due to fired, periodic ones are
+	// added again. Return 0 without doing anything if another thread holds lock.
+	Bool TryAdvance(U64 now, std::vector<TimerFire>& fired);
+
+	void Link(U32 index);
+	void Unlink(U32 index);
+	void Free(U32 index);
+
+	TimerWheel(const TimerWheel& other) = delete;
+	TimerWheel& operator=(const TimerWheel& other) = delete;
+};
@@ -0,0 +1,313 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+#include "Topology.hpp"
+
+CpuLocation LocateCpuMask(const std::vector<CpuLocation>& cpus, const CpuMask& mask)
+{
+	CpuLocation location;
+	Bool first = 1;
+
+	for (U32 i = 0; i < CpuMask::WordCount * 64; i++)
+	{
+		if (!mask.Test(i))
+			continue;
+
+		if (i >= cpus.size())
+			return CpuLocation();
+
+		if (first)
+		{
+			location = cpus[i];
+			first = 0;
+			continue;
+		}
+
+		// a mask spanning several cores only keeps what they have in common
+		if (location.core != cpus[i].core)
+			location.core = -1;
+
+		if (location.cache != cpus[i].cache)
+			location.cache = -1;
+
+		if (location.numaNode != cpus[i].numaNode)
+			location.numaNode = -1;
+
+		if (location.package != cpus[i].package)
+			location.package = -1;
+	}
+
+	return location;
+}
+
+#if SYSTEM_WINDOWS
+
+#include <Windows.h>
+
+// Store value into field of every cpu in affinity, -1 stores the lowest cpu of affinity instead
+static void SetLocations(std::vector<CpuLocation>& cpus, const GROUP_AFFINITY& affinity, I32 CpuLocation::* field,
+	I32 value)
+{
+	U64 mask = (U64)affinity.Mask;
+
+	if (mask == 0 || affinity.Group >= CpuMask::WordCount)
+		return;
+
+	if (value < 0)
+		value = (I32)(affinity.Group * 64 + CountTrailingZeros(mask));
+
+	for (U32 i = 0; i < 64; i++)
+	{
+		if ((mask >> i) & 1)
+			cpus[affinity.Group * 64 + i].*field = value;
+	}
+}
+
+Bool ReadCpuTopology(std::vector<CpuLocation>& cpus)
+{
+	DWORD length = 0;
+
+	if (GetLogicalProcessorInformationEx(RelationAll, nullptr, &length) ||
+		GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+		return 0;
+
+	std::vector<Byte> buffer(length);
+	std::vector<U32> cacheLevels(CpuMask::WordCount * 64, 0);
+	I32 packages = 0;
+
+	if (!GetLogicalProcessorInformationEx(RelationAll, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)buffer.data(),
+		&length))
+		return 0;
+
+	cpus.assign(CpuMask::WordCount * 64, CpuLocation());
+
+	for (DWORD offset = 0; offset < length;)
+	{
+		PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)(buffer.data() + offset);
+
+		switch (info->Relationship)
+		{
+		case RelationProcessorCore:
+			SetLocations(cpus, info->Processor.GroupMask[0], &CpuLocation::core, -1);
+			break;
+
+		case RelationProcessorPackage:
+			for (WORD i = 0; i < info->Processor.GroupCount; i++)
+				SetLocations(cpus, info->Processor.GroupMask[i], &CpuLocation::package, packages);
+
+			packages++;
+			break;
+
+		case RelationNumaNode:
+			SetLocations(cpus, info->NumaNode.GroupMask, &CpuLocation::numaNode, (I32)info->NumaNode.NodeNumber);
+			break;
+
+		case RelationCache:
+		{
+			// keep the cache of the highest level each cpu is part of
+			GROUP_AFFINITY affinity = info->Cache.GroupMask;
+
+			if (affinity.Mask == 0 || affinity.Group >= CpuMask::WordCount)
+				break;
+
+			if (info->Cache.Level >= cacheLevels[affinity.Group * 64 + CountTrailingZeros((U64)affinity.Mask)])
+			{
+				for (U32 i = 0; i < 64; i++)
+				{
+					if (((U64)affinity.Mask >> i) & 1)
+						cacheLevels[affinity.Group * 64 + i] = info->Cache.Level;
+				}
+
+				SetLocations(cpus, affinity, &CpuLocation::cache, -1);
+			}
+			break;
+		}
+
+		default:
+			break;
+		}
+
+		offset += info->Size;
+	}
+
+	return 1;
+}
+
+Bool SetCurrentThreadAffinity(const CpuMask& mask)
+{
+	// a thread lives in a single processor group, use the first one that has a cpu set
+	for (U32 i = 0; i < CpuMask::WordCount; i++)
+	{
+		if (mask.words[i] == 0)
+			continue;
+
+		GROUP_AFFINITY affinity;
+		memset(&affinity, 0, sizeof(affinity));
+		affinity.Mask = (KAFFINITY)mask.words[i];
+		affinity.Group = (WORD)i;
+
+		return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+	}
+
+	return 0;
+}
+
+Bool BindMemoryToNumaNode(void* memory, UPtr size, U32 numaNode)
+{
+	// committed pages can not be rebound, they end up on the node of the thread touching them first
+	return 0;
+}
+
+#else
+
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Read the first number of a sysfs file, for cpu lists that is the lowest cpu of the set
+static I32 ReadFirstNumber(const char* path)
+{
+	FILE* file = fopen(path, "r");
+
+	if (file == nullptr)
+		return -1;
+
+	I32 value;
+
+	if (fscanf(file, "%d", &value) != 1)
+		value = -1;
+
+	fclose(file);
+	return value;
+}
+
+Bool ReadCpuTopology(std::vector<CpuLocation>& cpus)
+{
+	char path[256];
+	I32 count = (I32)sysconf(_SC_NPROCESSORS_CONF);
+	Bool known = 0;
+
+	if (count <= 0)
+		return 0;
+
+	if (count > CpuMask::WordCount * 64)
+		count = CpuMask::WordCount * 64;
+
+	cpus.assign((UPtr)count, CpuLocation());
+
+	for (I32 cpu = 0; cpu < count; cpu++)
+	{
+		CpuLocation& location = cpus[cpu];
+
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_cpus_list", cpu);
+
+		if ((location.core = ReadFirstNumber(path)) < 0)
+		{
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+			location.core = ReadFirstNumber(path);
+		}
+
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+		location.package = ReadFirstNumber(path);
+
+		// the cache index with the highest level is the last level cache
+		for (I32 index = 0, bestLevel = -1; ; index++)
+		{
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, index);
+			I32 level = ReadFirstNumber(path);
+
+			if (level < 0)
+				break;
+
+			if (level < bestLevel)
+				continue;
+
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+			location.cache = ReadFirstNumber(path);
+			bestLevel = level;
+		}
+
+		// the node shows up as a nodeN link in the cpu directory
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+		DIR* directory = opendir(path);
+
+		if (directory != nullptr)
+		{
+			dirent* entry;
+
+			while ((entry = readdir(directory)) != nullptr)
+			{
+				if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+				{
+					location.numaNode = atoi(entry->d_name + 4);
+					break;
+				}
+			}
+
+			closedir(directory);
+		}
+
+		known |= location.core >= 0 || location.cache >= 0 || location.numaNode >= 0 || location.package >= 0;
+	}
+
+	return known;
+}
+
+Bool SetCurrentThreadAffinity(const CpuMask& mask)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+
+	for (U32 i = 0; i < CpuMask::WordCount * 64 && i < CPU_SETSIZE; i++)
+	{
+		if (mask.Test(i))
+			CPU_SET(i, &set);
+	}
+
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) == 0;
+}
+
+Bool BindMemoryToNumaNode(void* memory, UPtr size, U32 numaNode)
+{
+	UPtr pageSize = (UPtr)sysconf(_SC_PAGESIZE);
+	UPtr begin = ((UPtr)memory + pageSize - 1) & ~(pageSize - 1);
+	UPtr end = ((UPtr)memory + size) & ~(pageSize - 1);
+
+	if (end <= begin || numaNode >= 64)
+		return 0;
+
+	unsigned long nodeMask = 1ul << numaNode;
+
+	return syscall(SYS_mbind, (void*)begin, end - begin, MPOL_PREFERRED, &nodeMask, sizeof(nodeMask) * 8,
+		MPOL_MF_MOVE) == 0;
+}
+
+#endif
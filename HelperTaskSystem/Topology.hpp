@@ -0,0 +1,96 @@
+/**************************************************************************************************
+* MIT License
+* 
+* Copyright (c) 2023 Nick Wettstein (@Schmicki)
+* 
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+**************************************************************************************************/
+
+
+#pragma once
+
+#include "Core.hpp"
+
+// Set of logical processors, bit i of word i / 64 stands for cpu i. On windows every word is one
+// processor group.
+struct CpuMask
+{
+	enum { WordCount = 16 };
+
+	U64 words[WordCount];
+
+	CpuMask() : words() {}
+
+	void Set(U32 cpu) { words[cpu / 64] |= (U64)1 << (cpu % 64); }
+	Bool Test(U32 cpu) const { return (Bool)((words[cpu / 64] >> (cpu % 64)) & 1); }
+
+	Bool IsEmpty() const
+	{
+		for (U32 i = 0; i < WordCount; i++)
+		{
+			if (words[i] != 0)
+				return 0;
+		}
+
+		return 1;
+	}
+};
+
+// Where a logical processor sits. core and cache hold the lowest cpu of the core and of the last
+// level cache it belongs to, -1 where the system did not tell.
+struct CpuLocation
+{
+	enum Distance { DCore, DCache, DNode, DRemote, DCount };
+
+	I32 core;
+	I32 cache;
+	I32 numaNode;
+	I32 package;
+
+	CpuLocation() : core(-1), cache(-1), numaNode(-1), package(-1) {}
+
+	// Unknown fields never match, without numa nodes the package stands in for the node.
+	U32 DistanceTo(const CpuLocation& other) const
+	{
+		if (core >= 0 && core == other.core)
+			return DCore;
+
+		if (cache >= 0 && cache == other.cache)
+			return DCache;
+
+		if (numaNode >= 0 ? numaNode == other.numaNode : package >= 0 && package == other.package)
+			return DNode;
+
+		return DRemote;
+	}
+};
+
+// Fill cpus with the location of every logical processor, indexed like CpuMask, return 0 if the
+// topology is unknown.
+Bool ReadCpuTopology(std::vector<CpuLocation>& cpus);
+
+// The location fields all cpus in mask share, an empty mask or a mask outside of cpus is unknown.
+CpuLocation LocateCpuMask(const std::vector<CpuLocation>& cpus, const CpuMask& mask);
+
+// Pin the calling thread to mask, return 0 if the system refused.
+Bool SetCurrentThreadAffinity(const CpuMask& mask);
+
+// Prefer numaNode for the whole pages inside [memory, memory + size) and move pages that were
+// already touched, return 0 if not supported.
+Bool BindMemoryToNumaNode(void* memory, UPtr size, U32 numaNode);
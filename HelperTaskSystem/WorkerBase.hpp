@@ -30,7 +30,70 @@ class WorkerBase
 {
 public:
 
+	// parent finishes once task and all of its other children finished. Before parent is submitted
+	// any thread may add children to it. Afterwards only parent itself while it runs and its running
+	// descendants may, they hold it back from finishing. Pass CurrentTask() to spawn children of the
+	// running task, recursive algorithms then wait for the whole tree with WaitOnTask on the root.
 	virtual TaskHandle NewTask(TaskFunction function, void* args, TaskHandle dependency, TaskHandle parent) = 0;
 	virtual void SubmitTask(TaskHandle task) = 0;
-	virtual void WaitOnTask(TaskHandle task) = 0;
+
+	// Task will not start before dependency finished. Only call this before task is submitted.
+	virtual void AddDependency(TaskHandle task, TaskHandle dependency) = 0;
+
+	// Set one of TaskPriority, tasks start with the priority of their parent or TPNormal. Only call
+	// this before task is submitted.
+	virtual void SetPriority(TaskHandle task, U32 priority) = 0;
+
+	// Tasks with a canceled token finish without running, children created later inherit the
+	// token of their parent. Only call this before task is submitted.
+	virtual void SetCancellationToken(TaskHandle task, CancellationToken* token) = 0;
+
+	// Priority and token of a task that did not finish yet, nullptr if it has no token. Tasks that
+	// are not children of CurrentTask() read them to run like its children would.
+	virtual U32 GetPriority(TaskHandle task) = 0;
+	virtual CancellationToken* GetCancellationToken(TaskHandle task) = 0;
+
+	// Point the args of an unsubmitted task to TaskStorage::Size bytes inside its node, aligned to
+	// CACHE_LINE. destroy runs on them once the task and all of its children finished.
+	virtual void* AttachStorage(TaskHandle task, TaskStorageDestructor destroy) = 0;
+
+	// Create count tasks running function, args may be nullptr or hold one argument per task.
+	virtual void NewTasks(U32 count, TaskFunction function, void** args, TaskHandle parent, TaskHandle* outHandles) = 0;
+	virtual void SubmitTasks(const TaskHandle* tasks, U32 count) = 0;
+
+	// Return 1 if another worker is idle and would pick up work split off by the calling task.
+	virtual Bool ShouldSplit() = 0;
+
+	// Return 1 if the calling task was canceled or its tree failed, long running tasks poll it and
+	// return early.
+	virtual Bool IsCanceled() = 0;
+
+	// Handle of the task running on this worker, TaskHandle() outside of tasks.
+	virtual TaskHandle CurrentTask() = 0;
+
+	// Run other tasks until task finished and return its TaskResult, park until it finished once
+	// there is nothing left to run. Dependents of a failed task still run, only its ancestors see
+	// the failure.
+	virtual U32 WaitOnTask(TaskHandle task) = 0;
+
+	// Run tasks like a helper thread until predicate(args) returns 1, it is checked before every
+	// task and whenever the worker wakes up. Whoever makes it true outside of the tasks this worker
+	// runs calls HelperTaskSystem::Wake on it afterwards, the worker may be parked.
+	virtual void RunUntil(TaskPredicate predicate, void* args) = 0;
+
+	// Return size bytes of scratch memory aligned to alignment, a power of two. It stays valid
+	// until the calling task returns and is never freed by hand, outside of tasks it lives as long
+	// as the task system. Memory that outlives the task, like buffers handed to other tasks, comes
+	// from AllocateSmallBlock instead.
+	virtual void* AllocateScratch(UPtr size, UPtr alignment) = 0;
+
+	// Submit a new task running function once delayMilliseconds passed and then every
+	// periodMilliseconds until the timer is canceled, a period of 0 fires once. Idle workers drive
+	// the timers, a timer fires late while every worker is stuck in a long task.
+	virtual TimerHandle SubmitTimer(TaskFunction function, void* args, U32 delayMilliseconds,
+		U32 periodMilliseconds) = 0;
+
+	// Return 1 if timer was pending and will not submit tasks anymore, a timer that is due already
+	// may still submit its task once.
+	virtual Bool CancelTimer(TimerHandle timer) = 0;
 };
\ No newline at end of file
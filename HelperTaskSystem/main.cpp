@@ -22,20 +22,1000 @@
 * SOFTWARE.
 **************************************************************************************************/
 
+#include <algorithm>
+#include <stdexcept>
 #include "HelperTaskSystem.hpp"
+#include "ParallelFor.hpp"
+#include "Coroutine.hpp"
+#include "TaskClosure.hpp"
 
 void ExampleTask(WorkerBase* worker, void* text)
 {
 	std::cout << (char*)text << "\n";
 }
 
+void CountTask(WorkerBase* worker, void* counter)
+{
+	((std::atomic<U32>*)counter)->fetch_add(1, std::memory_order_relaxed);
+}
+
+struct ChainLink
+{
+	std::atomic<U32>* counter;
+	U32 position;
+	Bool* failed;
+};
+
+// Every link checks that all links before it already ran
+void ChainTask(WorkerBase* worker, void* args)
+{
+	ChainLink* link = (ChainLink*)args;
+
+	if (link->counter->fetch_add(1, std::memory_order_relaxed) != link->position)
+		*link->failed = 1;
+}
+
+struct SquareMap
+{
+	const U32* values;
+
+	U64 operator()(I64 i) const
+	{
+		return (U64)values[i] * (U64)values[i];
+	}
+};
+
+struct SumCombine
+{
+	U64 operator()(U64 a, U64 b) const
+	{
+		return a + b;
+	}
+};
+
+struct ScaleBody
+{
+	U32* values;
+
+	void operator()(I64 i) const
+	{
+		values[i] = values[i] * 3 + 1;
+	}
+};
+
+static void ParallelReduceBenchmark(WorkerBase* worker, const U32* values, I64 count)
+{
+	SquareMap map;
+	map.values = values;
+	U64 serialResult = 0, parallelResult = 0;
+
+	{
+		test_loop(0x10)
+		{
+			test_loop_begin_test;
+
+			serialResult = 0;
+			for (I64 i = 0; i < count; i++)
+				serialResult += map(i);
+
+			test_loop_end_test;
+		}
+		test_loop_print_result("Serial loop, " << count << " elements" << " - " << ((F64)_avg__ / (F64)count) << " ns/element");
+	}
+
+	{
+		test_loop(0x10)
+		{
+			test_loop_begin_test;
+
+			parallelResult = ParallelReduce(worker, 0, count, 0x400, (U64)0, map, SumCombine());
+
+			test_loop_end_test;
+		}
+		test_loop_print_result("ParallelReduce, " << count << " elements" << " - " << ((F64)_avg__ / (F64)count) << " ns/element");
+	}
+
+	if (serialResult != parallelResult)
+		std::cout << "ParallelReduce result mismatch!\n";
+}
+
+struct WakeLatencyTest
+{
+	Futex signal;
+	std::atomic<I64> sent;
+	std::atomic<I64> latency;
+	std::atomic<I32> ack;
+	I64 spinNanoseconds;
+	U32 rounds;
+
+	WakeLatencyTest(I64 spinNanoseconds, U32 rounds)
+		: signal(0), sent(0), latency(0), ack(0), spinNanoseconds(spinNanoseconds), rounds(rounds)
+	{}
+};
+
+// Simplified HelperTaskSystemWorker::Sleep, poll for spinNanoseconds and then park on the futex
+static void WakeLatencyWaiter(WakeLatencyTest* test)
+{
+	for (I32 round = 1; round <= (I32)test->rounds; round++)
+	{
+		TimePoint start = Clock::now();
+
+		while (test->signal.val.load(std::memory_order_acquire) != round &&
+			std::chrono::nanoseconds(Clock::now() - start).count() < test->spinNanoseconds);
+
+		test->signal.Wait(round - 1, UINT32_MAX);
+
+		test->latency.store(Clock::now().time_since_epoch().count() - test->sent.load(std::memory_order_relaxed),
+			std::memory_order_relaxed);
+		test->ack.store(round, std::memory_order_release);
+	}
+}
+
+static void WakeLatencyBenchmark(const char* name, I64 spinNanoseconds, I64 delayNanoseconds)
+{
+	WakeLatencyTest test(spinNanoseconds, 0x100);
+	std::thread waiter(&WakeLatencyWaiter, &test);
+
+	test_loop(test.rounds)
+	{
+		spinWait((F32)delayNanoseconds / 1000000000.0f);
+
+		test.sent.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+		test.signal.val.store((I32)_i_ + 1, std::memory_order_release);
+		test.signal.WakeSingle();
+
+		while (test.ack.load(std::memory_order_acquire) != (I32)_i_ + 1)
+			std::this_thread::yield();
+
+		I64 latency = test.latency.load(std::memory_order_relaxed);
+		test_loop_add_sample(latency);
+	}
+	test_loop_print_result(name << " - wake-to-run");
+
+	waiter.join();
+}
+
+struct PriorityLatencyTest
+{
+	std::atomic<U32> stop;
+	std::atomic<U32> running;
+	std::atomic<U32> done;
+	std::atomic<U32> loadDone;
+	U32 loadPriority;
+	I64* submitted;
+	I64* latencies;
+};
+
+struct PriorityProbe
+{
+	PriorityLatencyTest* test;
+	U32 slot;
+};
+
+// Each load task runs for 20us and queues the next one until the test stops
+static void PriorityLoadTask(WorkerBase* worker, void* args)
+{
+	PriorityLatencyTest* test = (PriorityLatencyTest*)args;
+
+	spinWait(0.00002f);
+	test->loadDone.fetch_add(1, std::memory_order_relaxed);
+
+	if (test->stop.load(std::memory_order_acquire) != 0)
+	{
+		test->running.fetch_sub(1, std::memory_order_release);
+		return;
+	}
+
+	TaskHandle next = worker->NewTask(&PriorityLoadTask, test, TaskHandle(), TaskHandle());
+	worker->SetPriority(next, test->loadPriority);
+	worker->SubmitTask(next);
+}
+
+static void PriorityProbeTask(WorkerBase* worker, void* args)
+{
+	PriorityProbe* probe = (PriorityProbe*)args;
+	PriorityLatencyTest* test = probe->test;
+
+	test->latencies[probe->slot] = Clock::now().time_since_epoch().count() - test->submitted[probe->slot];
+	test->done.fetch_add(1, std::memory_order_release);
+}
+
+static void PriorityLatencyBenchmark(WorkerBase* worker, U32 workerCount, const char* name, U32 loadPriority,
+	U32 probePriority)
+{
+	const U32 probeCount = 0x200;
+
+	PriorityLatencyTest test;
+	test.stop.store(0, std::memory_order_relaxed);
+	test.running.store(workerCount * 2, std::memory_order_relaxed);
+	test.done.store(0, std::memory_order_relaxed);
+	test.loadDone.store(0, std::memory_order_relaxed);
+	test.loadPriority = loadPriority;
+	test.submitted = Allocate<I64>(probeCount);
+	test.latencies = Allocate<I64>(probeCount);
+
+	PriorityProbe* probes = Allocate<PriorityProbe>(probeCount);
+
+	// twice as many load chains as workers keeps every worker busy
+	for (U32 i = 0; i < workerCount * 2; i++)
+	{
+		TaskHandle task = worker->NewTask(&PriorityLoadTask, &test, TaskHandle(), TaskHandle());
+		worker->SetPriority(task, loadPriority);
+		worker->SubmitTask(task);
+	}
+
+	for (U32 i = 0; i < probeCount; i++)
+	{
+		spinWait(0.0001f);
+
+		probes[i].test = &test;
+		probes[i].slot = i;
+
+		TaskHandle task = worker->NewTask(&PriorityProbeTask, probes + i, TaskHandle(), TaskHandle());
+		worker->SetPriority(task, probePriority);
+		test.submitted[i] = Clock::now().time_since_epoch().count();
+		worker->SubmitTask(task);
+	}
+
+	U32 loadDone = test.loadDone.load(std::memory_order_relaxed);
+	test.stop.store(1, std::memory_order_release);
+
+	while (test.running.load(std::memory_order_acquire) != 0 || test.done.load(std::memory_order_acquire) != probeCount)
+		std::this_thread::yield();
+
+	std::sort(test.latencies, test.latencies + probeCount);
+
+	std::cout << name << " - p50: " << test.latencies[probeCount / 2] << ", p99: " <<
+		test.latencies[probeCount * 99 / 100] << ", max: " << test.latencies[probeCount - 1] <<
+		", load tasks run: " << loadDone << "\n";
+
+	Free(probes);
+	Free(test.latencies);
+	Free(test.submitted);
+}
+
+static const char* ResultName(U32 result)
+{
+	return result == TaskResult::TROk ? "ok" : result == TaskResult::TRCanceled ? "canceled" : "failed";
+}
+
+#if defined(__cpp_impl_coroutine)
+
+// Fans out count counting tasks and resumes once all of them ran
+static AsyncTask<U32> AsyncCountStage(std::atomic<U32>* counter, U32 count)
+{
+	WorkerBase* worker = co_await CurrentWorker();
+	TaskHandle join = worker->NewTask(nullptr, nullptr, TaskHandle(), TaskHandle());
+
+	for (U32 i = 0; i < count; i++)
+		worker->SubmitTask(worker->NewTask(&CountTask, counter, TaskHandle(), join));
+
+	worker->SubmitTask(join);
+	co_await join;
+
+	co_return counter->load(std::memory_order_relaxed);
+}
+
+static AsyncTask<U32> AsyncPipeline(std::atomic<U32>* counter)
+{
+	U32 first = co_await AsyncCountStage(counter, 0x1000);
+	U32 second = co_await AsyncCountStage(counter, 0x1000);
+
+	co_return first + second;
+}
+
+// Awaiting an empty handle queues the resume task right away
+static AsyncTask<void> AsyncYieldLoop(U32 count)
+{
+	for (U32 i = 0; i < count; i++)
+		co_await TaskHandle();
+}
+
+#if defined(CPP_HAS_EXCEPTIONS)
+// Throws in its second step, its task fails and the exception reaches whoever awaits it
+static AsyncTask<U32> AsyncThrowingStage()
+{
+	co_await TaskHandle();
+	throw std::runtime_error("AsyncThrowingStage");
+}
+
+static AsyncTask<U32> AsyncCatchingPipeline()
+{
+	U32 result = 0;
+
+	try
+	{
+		result = co_await AsyncThrowingStage();
+	}
+	catch (const std::runtime_error&)
+	{
+		result = 1;
+	}
+
+	co_return result;
+}
+#endif
+
+static void CoroutineBenchmark(WorkerBase* worker)
+{
+	std::atomic<U32> counter(0);
+	Bool failed = 0;
+
+	{
+		test_loop(0x10)
+		{
+			counter.store(0, std::memory_order_relaxed);
+
+			test_loop_begin_test;
+
+			AsyncTask<U32> pipeline = AsyncPipeline(&counter);
+			worker->WaitOnTask(pipeline.Spawn(worker));
+
+			test_loop_end_test;
+
+			if (pipeline.Result() != 0x3000)
+				failed = 1;
+		}
+		test_loop_print_result("Coroutine pipeline, 2 stages of 0x1000 tasks" << " - " << ((F64)_avg__ / (F64)0x2000) << " ns/task");
+	}
+
+	if (failed)
+		std::cout << "Coroutine pipeline result mismatch!\n";
+
+	{
+		test_loop(0x10)
+		{
+			test_loop_begin_test;
+
+			AsyncTask<void> loop = AsyncYieldLoop(0x10000);
+			worker->WaitOnTask(loop.Spawn(worker));
+
+			test_loop_end_test;
+		}
+		test_loop_print_result("Coroutine resume" << " - " << ((F64)_avg__ / (F64)0x10000) << " ns/resume");
+	}
+
+#if defined(CPP_HAS_EXCEPTIONS)
+	AsyncTask<U32> throwing = AsyncThrowingStage();
+	U32 result = worker->WaitOnTask(throwing.Spawn(worker));
+	Bool rethrown = 0;
+
+	try
+	{
+		(void)throwing.Result();
+	}
+	catch (const std::runtime_error&)
+	{
+		rethrown = 1;
+	}
+
+	AsyncTask<U32> catching = AsyncCatchingPipeline();
+	worker->WaitOnTask(catching.Spawn(worker));
+
+	std::cout << "Throwing coroutine - result: " << ResultName(result) << ", Result throws: " << (U32)rethrown <<
+		", awaiting coroutine caught it: " << (U32)(catching.Result() == 1) << "\n";
+#endif
+}
+
+#endif
+
+struct CountArgs
+{
+	std::atomic<U32>* counter;
+	U32 amount;
+};
+
+// Baseline for closures, the submitter allocates the args and the task frees them
+void HeapArgsCountTask(WorkerBase* worker, void* args)
+{
+	CountArgs* countArgs = (CountArgs*)args;
+	countArgs->counter->fetch_add(countArgs->amount, std::memory_order_relaxed);
+	Free(countArgs);
+}
+
+// Runs 0x100000 counting tasks as children of joins of 0x1000, the caller helps running them
+static void ClosureBenchmark(WorkerBase* worker, const char* name)
+{
+	std::atomic<U32> counter(0);
+
+	{
+		test_loop(0x10)
+		{
+			test_loop_begin_test;
+
+			for (U32 batch = 0; batch < 0x100; batch++)
+			{
+				TaskHandle join = worker->NewTask(nullptr, nullptr, TaskHandle(), TaskHandle());
+
+				for (U32 i = 0; i < 0x1000; i++)
+				{
+					CountArgs* args = Allocate<CountArgs>(1);
+					args->counter = &counter;
+					args->amount = 1;
+
+					worker->SubmitTask(worker->NewTask(&HeapArgsCountTask, args, TaskHandle(), join));
+				}
+
+				worker->SubmitTask(join);
+				worker->WaitOnTask(join);
+			}
+
+			test_loop_end_test;
+		}
+		test_loop_print_result(name << ", heap allocated args" << " - " << ((F64)_avg__ / (F64)0x100000) << " ns/task");
+	}
+
+	{
+		test_loop(0x10)
+		{
+			test_loop_begin_test;
+
+			for (U32 batch = 0; batch < 0x100; batch++)
+			{
+				TaskHandle join = worker->NewTask(nullptr, nullptr, TaskHandle(), TaskHandle());
+
+				for (U32 i = 0; i < 0x1000; i++)
+				{
+					std::atomic<U32>* target = &counter;
+					U32 amount = 1;
+
+					worker->SubmitTask(NewTask(worker, [target, amount](WorkerBase*)
+					{
+						target->fetch_add(amount, std::memory_order_relaxed);
+					}, TaskHandle(), join));
+				}
+
+				worker->SubmitTask(join);
+				worker->WaitOnTask(join);
+			}
+
+			test_loop_end_test;
+		}
+		test_loop_print_result(name << ", inline closure" << " - " << ((F64)_avg__ / (F64)0x100000) << " ns/task");
+	}
+
+	// closures larger than the node storage go through a small block
+	struct LargeCapture
+	{
+		U64 values[16];
+	};
+
+	LargeCapture capture;
+	for (U32 i = 0; i < 16; i++)
+		capture.values[i] = i;
+
+	counter.store(0, std::memory_order_relaxed);
+	TaskHandle join = worker->NewTask(nullptr, nullptr, TaskHandle(), TaskHandle());
+
+	for (U32 i = 0; i < 0x1000; i++)
+	{
+		std::atomic<U32>* target = &counter;
+
+		worker->SubmitTask(NewTask(worker, [target, capture](WorkerBase*)
+		{
+			U32 sum = 0;
+			for (U32 j = 0; j < 16; j++)
+				sum += (U32)capture.values[j];
+
+			target->fetch_add(sum, std::memory_order_relaxed);
+		}, TaskHandle(), join));
+	}
+
+	worker->SubmitTask(join);
+	worker->WaitOnTask(join);
+
+	if (counter.load(std::memory_order_relaxed) != 0x1000 * 120)
+		std::cout << "Large closure result mismatch!\n";
+}
+
+// Sorts the right part itself and hands the left part to a child of the running task, the root
+// finishes once the whole tree of children finished
+static void ParallelQuickSort(WorkerBase* worker, U32* begin, U32* end)
+{
+	while (end - begin > 0x800)
+	{
+		U32 a = begin[0], b = begin[(end - begin) / 2], c = end[-1];
+		U32 pivot = std::max(std::min(a, b), std::min(std::max(a, b), c));
+
+		U32* less = std::partition(begin, end, [pivot](U32 value) { return value < pivot; });
+		U32* greater = std::partition(less, end, [pivot](U32 value) { return value == pivot; });
+
+		worker->SubmitTask(NewTask(worker, [begin, less](WorkerBase* worker)
+		{
+			ParallelQuickSort(worker, begin, less);
+		}, TaskHandle(), worker->CurrentTask()));
+
+		begin = greater;
+	}
+
+	std::sort(begin, end);
+}
+
+static void QuickSortBenchmark(WorkerBase* worker)
+{
+	const U32 count = 0x400000;
+	U32* values = Allocate<U32>(count);
+	U32 seed = 1;
+	Bool sorted = 1;
+
+	{
+		test_loop(0x8)
+		{
+			for (U32 i = 0; i < count; i++)
+				values[i] = (seed = seed * 1664525 + 1013904223);
+
+			test_loop_begin_test;
+
+			std::sort(values, values + count);
+
+			test_loop_end_test;
+		}
+		test_loop_print_result("std::sort" << " - " << ((F64)_avg__ / (F64)count) << " ns/element");
+	}
+
+	{
+		test_loop(0x8)
+		{
+			for (U32 i = 0; i < count; i++)
+				values[i] = (seed = seed * 1664525 + 1013904223);
+
+			test_loop_begin_test;
+
+			TaskHandle root = NewTask(worker, [values, count](WorkerBase* worker)
+			{
+				ParallelQuickSort(worker, values, values + count);
+			});
+
+			worker->SubmitTask(root);
+			worker->WaitOnTask(root);
+
+			test_loop_end_test;
+
+			sorted = sorted && std::is_sorted(values, values + count);
+		}
+		test_loop_print_result("Recursive parallel quicksort" << " - " << ((F64)_avg__ / (F64)count) << " ns/element");
+	}
+
+	if (!sorted)
+		std::cout << "Parallel quicksort result mismatch!\n";
+
+	Free(values);
+}
+
+// Sorts both halves, the left one in a child it waits on, and merges them through a buffer from the
+// worker arena. The child may run on this worker inside WaitOnTask, it gets its own scope of the
+// arena and leaves the buffers of its parent alone.
+static void ParallelMergeSort(WorkerBase* worker, U32* begin, U32* end)
+{
+	if (end - begin <= 0x800)
+	{
+		std::sort(begin, end);
+		return;
+	}
+
+	U32* middle = begin + (end - begin) / 2;
+
+	TaskHandle left = NewTask(worker, [begin, middle](WorkerBase* worker)
+	{
+		ParallelMergeSort(worker, begin, middle);
+	});
+
+	worker->SubmitTask(left);
+	ParallelMergeSort(worker, middle, end);
+	worker->WaitOnTask(left);
+
+	U32* merged = (U32*)worker->AllocateScratch((UPtr)(end - begin) * sizeof(U32), alignof(U32));
+	std::merge(begin, middle, middle, end, merged);
+	std::copy(merged, merged + (end - begin), begin);
+}
+
+static void MergeSortBenchmark(WorkerBase* worker)
+{
+	const U32 count = 0x400000;
+	U32* values = Allocate<U32>(count);
+	U32 seed = 1;
+	Bool sorted = 1;
+
+	test_loop(0x8)
+	{
+		for (U32 i = 0; i < count; i++)
+			values[i] = (seed = seed * 1664525 + 1013904223);
+
+		test_loop_begin_test;
+
+		TaskHandle root = NewTask(worker, [values, count](WorkerBase* worker)
+		{
+			ParallelMergeSort(worker, values, values + count);
+		});
+
+		worker->SubmitTask(root);
+		worker->WaitOnTask(root);
+
+		test_loop_end_test;
+
+		sorted = sorted && std::is_sorted(values, values + count);
+	}
+	test_loop_print_result("Parallel merge sort with scratch buffers" << " - " << ((F64)_avg__ / (F64)count) << " ns/element");
+
+	if (!sorted)
+		std::cout << "Parallel merge sort result mismatch!\n";
+
+	Free(values);
+}
+
+#if defined(CPP_HAS_EXCEPTIONS)
+void ThrowingTask(WorkerBase* worker, void* args)
+{
+	throw std::runtime_error("ThrowingTask");
+}
+
+// The first child throws, the children that did not start by then are skipped
+static void ErrorTest(WorkerBase* worker, Bool fail)
+{
+	std::atomic<U32> counter(0);
+	TaskHandle join = worker->NewTask(nullptr, nullptr, TaskHandle(), TaskHandle());
+
+	if (fail)
+		worker->SubmitTask(worker->NewTask(&ThrowingTask, nullptr, TaskHandle(), join));
+
+	for (U32 i = 0; i < 0x10000; i++)
+		worker->SubmitTask(worker->NewTask(&CountTask, &counter, TaskHandle(), join));
+
+	worker->SubmitTask(join);
+	U32 result = worker->WaitOnTask(join);
+
+	std::cout << (fail ? "First child throws" : "No child throws") << " - result: " << ResultName(result) <<
+		", children ran: " << counter.load(std::memory_order_relaxed) << " of 65536\n";
+}
+
+struct TreeFailure
+{
+	std::atomic<U32> started;
+	std::atomic<U32> sawFailure;
+};
+
+// Waits for the grandchild in the other subtree to run, then throws
+void LateThrowingTask(WorkerBase* worker, void* args)
+{
+	TreeFailure* test = (TreeFailure*)args;
+	TimePoint start = Clock::now();
+
+	while (test->started.load(std::memory_order_acquire) == 0 &&
+		std::chrono::nanoseconds(Clock::now() - start).count() < 1000000000)
+		std::this_thread::yield();
+
+	throw std::runtime_error("LateThrowingTask");
+}
+
+// Polls until the failure of its uncle reached it through the root
+void PollingGrandchildTask(WorkerBase* worker, void* args)
+{
+	TreeFailure* test = (TreeFailure*)args;
+	TimePoint start = Clock::now();
+	test->started.store(1, std::memory_order_release);
+
+	while (std::chrono::nanoseconds(Clock::now() - start).count() < 1000000000)
+	{
+		if (worker->IsCanceled())
+		{
+			test->sawFailure.store(1, std::memory_order_relaxed);
+			return;
+		}
+
+		std::this_thread::yield();
+	}
+}
+
+void SpawnGrandchildTask(WorkerBase* worker, void* args)
+{
+	worker->SubmitTask(worker->NewTask(&PollingGrandchildTask, args, TaskHandle(), worker->CurrentTask()));
+}
+
+// One child of the root throws while a grandchild below the other child runs, the grandchild has
+// to see the failure although only the root links the two subtrees
+static void TreeFailureTest(WorkerBase* worker)
+{
+	TreeFailure test;
+	test.started.store(0, std::memory_order_relaxed);
+	test.sawFailure.store(0, std::memory_order_relaxed);
+
+	TimePoint start = Clock::now();
+	TaskHandle root = worker->NewTask(nullptr, nullptr, TaskHandle(), TaskHandle());
+	worker->SubmitTask(worker->NewTask(&SpawnGrandchildTask, &test, TaskHandle(), root));
+	worker->SubmitTask(worker->NewTask(&LateThrowingTask, &test, TaskHandle(), root));
+	worker->SubmitTask(root);
+	U32 result = worker->WaitOnTask(root);
+	I64 time = std::chrono::nanoseconds(Clock::now() - start).count();
+
+	std::cout << "Failure in a sibling subtree - result: " << ResultName(result) << ", grandchild saw it: " <<
+		test.sawFailure.load(std::memory_order_relaxed) << ", took: " << time << " ns\n";
+}
+
+// A child throws before its parent got to run, the parent is then skipped, once through a
+// canceled token and once through the failure of its own parent. Skipping must not turn the
+// failure into a cancellation.
+static void SkippedParentTest(WorkerBase* worker)
+{
+	CancellationToken token;
+	TaskHandle root = worker->NewTask(nullptr, nullptr, TaskHandle(), TaskHandle());
+	TaskHandle child = worker->NewTask(&ThrowingTask, nullptr, TaskHandle(), root);
+
+	worker->SubmitTask(child);
+	(void)worker->WaitOnTask(child);
+
+	worker->SetCancellationToken(root, &token);
+	token.Cancel();
+	worker->SubmitTask(root);
+	U32 tokenResult = worker->WaitOnTask(root);
+
+	TaskHandle grandparent = worker->NewTask(nullptr, nullptr, TaskHandle(), TaskHandle());
+	TaskHandle parent = worker->NewTask(nullptr, nullptr, TaskHandle(), grandparent);
+	child = worker->NewTask(&ThrowingTask, nullptr, TaskHandle(), parent);
+
+	worker->SubmitTask(child);
+	(void)worker->WaitOnTask(child);
+
+	worker->SubmitTask(parent);
+	U32 parentResult = worker->WaitOnTask(parent);
+	worker->SubmitTask(grandparent);
+	U32 grandparentResult = worker->WaitOnTask(grandparent);
+
+	std::cout << "Child failed before its parent ran - canceled token: " << ResultName(tokenResult) <<
+		", failed tree: " << ResultName(parentResult) << ", grandparent: " << ResultName(grandparentResult) << "\n";
+}
+
+struct ThrowingSquareMap
+{
+	I64 throwAt;
+
+	U64 operator()(I64 i) const
+	{
+		if (i == throwAt)
+			throw std::runtime_error("ThrowingSquareMap");
+
+		return (U64)i * (U64)i;
+	}
+};
+
+// map throws once at the start of the range, which the caller runs, and once near the end, which
+// runs in a split off range whenever there was an idle worker
+static void ParallelReduceErrorTest(WorkerBase* worker)
+{
+	const I64 count = 0x100000;
+	const I64 throwAt[] = { 0, count - 1 };
+
+	for (U32 i = 0; i < 2; i++)
+	{
+		ThrowingSquareMap map;
+		map.throwAt = throwAt[i];
+		Bool thrown = 0;
+
+		try
+		{
+			(void)ParallelReduce(worker, 0, count, 0x400, (U64)0, map, SumCombine());
+		}
+		catch (const std::runtime_error&)
+		{
+			thrown = 1;
+		}
+
+		std::cout << "ParallelReduce, map throws at " << throwAt[i] << " - exception reached the caller: " <<
+			(U32)thrown << "\n";
+	}
+}
+#endif
+
+struct CancelTest
+{
+	std::atomic<U32> ran;
+	std::atomic<U32> polled;
+};
+
+// A bit of work that does not look at the token
+void CancelWorkTask(WorkerBase* worker, void* args)
+{
+	TimePoint start = Clock::now();
+	((CancelTest*)args)->ran.fetch_add(1, std::memory_order_relaxed);
+
+	while (std::chrono::nanoseconds(Clock::now() - start).count() < 2000);
+}
+
+// Runs until the request is canceled, with a one second safety limit
+void CancelPollTask(WorkerBase* worker, void* args)
+{
+	TimePoint start = Clock::now();
+
+	while (!worker->IsCanceled() && std::chrono::nanoseconds(Clock::now() - start).count() < 1000000000)
+		std::this_thread::yield();
+
+	((CancelTest*)args)->polled.store(worker->IsCanceled(), std::memory_order_relaxed);
+}
+
+// Cancels a request of 0x10000 tasks after 1ms, the children inherit the token of the root
+static void CancellationTest(WorkerBase* worker)
+{
+	CancellationToken token;
+	CancelTest test;
+	test.ran.store(0, std::memory_order_relaxed);
+	test.polled.store(0, std::memory_order_relaxed);
+
+	TaskHandle root = worker->NewTask(nullptr, nullptr, TaskHandle(), TaskHandle());
+	worker->SetCancellationToken(root, &token);
+
+	worker->SubmitTask(worker->NewTask(&CancelPollTask, &test, TaskHandle(), root));
+
+	for (U32 i = 0; i < 0x10000; i++)
+		worker->SubmitTask(worker->NewTask(&CancelWorkTask, &test, TaskHandle(), root));
+
+	worker->SubmitTask(root);
+	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	TimePoint canceled = Clock::now();
+	token.Cancel();
+	U32 result = worker->WaitOnTask(root);
+	I64 drain = std::chrono::nanoseconds(Clock::now() - canceled).count();
+
+	std::cout << "Canceled request - result: " << ResultName(result) << ", tasks ran: " <<
+		test.ran.load(std::memory_order_relaxed) << " of 65536, polling task saw the cancel: " <<
+		test.polled.load(std::memory_order_relaxed) << ", cancel to finish: " << drain << " ns\n";
+}
+
+// Runs a long ParallelFor, the split off ranges see the token of this task
+void CancelForTask(WorkerBase* worker, void* args)
+{
+	std::atomic<U32>* ran = (std::atomic<U32>*)args;
+
+	ParallelFor(worker, 0, 0x1000000, 0x100, [ran](I64)
+	{
+		ran->fetch_add(1, std::memory_order_relaxed);
+
+		TimePoint start = Clock::now();
+		while (std::chrono::nanoseconds(Clock::now() - start).count() < 100);
+	});
+}
+
+// Cancels a request running a ParallelFor after 1ms, every range stops at its next grain
+static void CancelParallelForTest(WorkerBase* worker)
+{
+	CancellationToken token;
+	std::atomic<U32> ran(0);
+
+	TaskHandle root = worker->NewTask(&CancelForTask, &ran, TaskHandle(), TaskHandle());
+	worker->SetCancellationToken(root, &token);
+
+	worker->SubmitTask(root);
+	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	TimePoint canceled = Clock::now();
+	token.Cancel();
+	U32 result = worker->WaitOnTask(root);
+	I64 drain = std::chrono::nanoseconds(Clock::now() - canceled).count();
+
+	std::cout << "Canceled ParallelFor - result: " << ResultName(result) << ", elements ran: " <<
+		ran.load(std::memory_order_relaxed) << " of 16777216, cancel to finish: " << drain << " ns\n";
+}
+
+struct DelayTest
+{
+	TimePoint submitted;
+	std::atomic<I64> delay;
+	std::atomic<U32> ticks;
+};
+
+void DelayedTask(WorkerBase* worker, void* args)
+{
+	DelayTest* test = (DelayTest*)args;
+	test->delay.store(std::chrono::nanoseconds(Clock::now() - test->submitted).count(), std::memory_order_relaxed);
+}
+
+void PeriodicTask(WorkerBase* worker, void* args)
+{
+	((DelayTest*)args)->ticks.fetch_add(1, std::memory_order_relaxed);
+}
+
+// A 5ms one shot timer and a 10ms periodic timer that is canceled after 105ms, the caller only sleeps
+static void TimerTest(WorkerBase* worker)
+{
+	DelayTest test;
+	test.delay.store(0, std::memory_order_relaxed);
+	test.ticks.store(0, std::memory_order_relaxed);
+	test.submitted = Clock::now();
+
+	(void)worker->SubmitTimer(&DelayedTask, &test, 5, 0);
+	TimerHandle periodic = worker->SubmitTimer(&PeriodicTask, &test, 10, 10);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(105));
+	Bool canceled = worker->CancelTimer(periodic);
+
+	// a tick that was due before the cancel may still be running
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+	std::cout << "5ms timer - fired after: " << test.delay.load(std::memory_order_relaxed) << " ns\n";
+	std::cout << "10ms periodic timer for 105ms - ticks: " << test.ticks.load(std::memory_order_relaxed) <<
+		", canceled: " << (U32)canceled << "\n";
+}
+
+struct ExternalTest
+{
+	HelperTaskSystem* taskSystem;
+	WorkerBase* mainWorker;
+	std::atomic<U32> ran;
+	U32 total;
+};
+
+void ExternalCountTask(WorkerBase* worker, void* args)
+{
+	ExternalTest* test = (ExternalTest*)args;
+
+	// the last task ends the RunUntil of the main thread, which may be parked
+	if (test->ran.fetch_add(1, std::memory_order_relaxed) + 1 == test->total)
+		test->taskSystem->Wake(test->mainWorker);
+}
+
+static Bool ExternalTestDone(void* args)
+{
+	ExternalTest* test = (ExternalTest*)args;
+	return test->ran.load(std::memory_order_relaxed) == test->total;
+}
+
+// Four threads that are not workers submit 0x40000 tasks each through their own submitter slot,
+// the main thread runs tasks until all of them ran
+static void ExternalSubmitterTest()
+{
+	const U32 threadCount = 4;
+	const U32 count = 0x40000;
+
+	HelperTaskSystemConfig config;
+	config.externalSubmitterCount = threadCount;
+
+	WorkerBase* worker;
+	HelperTaskSystem taskSystem(config, &worker);
+
+	ExternalTest test;
+	test.taskSystem = &taskSystem;
+	test.mainWorker = worker;
+	test.total = threadCount * count;
+
+	test_loop(0x10)
+	{
+		test.ran.store(0, std::memory_order_relaxed);
+
+		test_loop_begin_test;
+
+		std::vector<std::thread> threads;
+
+		for (U32 i = 0; i < threadCount; i++)
+		{
+			threads.push_back(std::thread([&]()
+			{
+				ExternalSubmitter submitter(taskSystem);
+
+				for (U32 j = 0; j < count; j++)
+				{
+					TaskHandle task = submitter.worker->NewTask(&ExternalCountTask, &test, TaskHandle(), TaskHandle());
+					submitter.worker->SubmitTask(task);
+				}
+			}));
+		}
+
+		worker->RunUntil(&ExternalTestDone, &test);
+
+		for (U32 i = 0; i < threadCount; i++)
+			threads[i].join();
+
+		test_loop_end_test;
+	}
+	test_loop_print_result("4 external submitters, main thread in RunUntil" << " - " <<
+		((F64)_avg__ / (F64)(threadCount * count)) << " ns/task");
+}
+
 int main(int argc, char** args)
 {
 	std::cout <<
 		"HelperTaskSystem\n"
 		"\n"
-		"A task system I wrote from my mind. Which uses a dynamic helper thread to split/steal\n"
-		"tasks. It uses a futex to go to sleep if there is no work in the loop.\n"
+		"A task system I wrote from my mind. Every worker owns a Chase-Lev deque, idle workers\n"
+		"steal from the others. It uses a futex to go to sleep if there is no work in the loop.\n"
 		"\n"
 		"Throughput test, submitting empty tasks.\n"
 		"\n";
@@ -57,6 +1037,233 @@ int main(int argc, char** args)
 			test_loop_end_test;
 		}
 		test_loop_print_result("HelperTaskSystem" << " - " << ((F64)_avg__ / (F64)0x100000) << " ns/task");
+	}
+
+	std::cout <<
+		"\n"
+		"Throughput test, submitting empty tasks in batches of 0x100.\n"
+		"\n";
+
+	{
+		WorkerBase* worker;
+		HelperTaskSystem taskSystem(&worker);
+		TaskHandle tasks[0x100];
+
+		test_loop(0x10)
+		{
+			test_loop_begin_test;
+
+			for (U32 i = 0; i < 0x100000; i += 0x100)
+			{
+				worker->NewTasks(0x100, nullptr, (void**)nullptr, TaskHandle(), tasks);
+				worker->SubmitTasks(tasks, 0x100);
+			}
+
+			test_loop_end_test;
+		}
+		test_loop_print_result("HelperTaskSystem batched" << " - " << ((F64)_avg__ / (F64)0x100000) << " ns/task");
+	}
+
+	std::cout <<
+		"\n"
+		"Throughput test, submitting counting tasks and waiting until all of them ran.\n"
+		"\n";
+
+	{
+		WorkerBase* worker;
+		HelperTaskSystem taskSystem(&worker);
+		std::atomic<U32> counter(0);
+
+		test_loop(0x10)
+		{
+			test_loop_begin_test;
+
+			counter.store(0, std::memory_order_relaxed);
+
+			for (U32 i = 0; i < 0x100000; i++)
+			{
+				TaskHandle task = worker->NewTask(&CountTask, &counter, TaskHandle(), TaskHandle());
+				worker->SubmitTask(task);
+			}
+
+			while (counter.load(std::memory_order_relaxed) != 0x100000)
+				std::this_thread::yield();
+
+			test_loop_end_test;
+		}
+		test_loop_print_result("HelperTaskSystem" << " - " << ((F64)_avg__ / (F64)0x100000) << " ns/task");
+
+		// Dependencies
+		std::cout <<
+			"\n"
+			"Dependency test, a chain of 0x10000 tasks where each one depends on the one before.\n"
+			"\n";
+
+		{
+			ChainLink* links = Allocate<ChainLink>(0x10000);
+			Bool failed = 0;
+
+			test_loop(0x10)
+			{
+				counter.store(0, std::memory_order_relaxed);
+
+				test_loop_begin_test;
+
+				TaskHandle last = TaskHandle();
+				TaskHandle first = TaskHandle();
+
+				for (U32 i = 0; i < 0x10000; i++)
+				{
+					links[i].counter = &counter;
+					links[i].position = i;
+					links[i].failed = &failed;
+
+					// submit in reverse order of execution, dependencies must hold the chain back
+					TaskHandle task = worker->NewTask(&ChainTask, links + i, TaskHandle(), TaskHandle());
+
+					if (last.index != UINT32_MAX)
+						worker->AddDependency(task, last);
+					else
+						first = task;
+
+					if (i != 0)
+						worker->SubmitTask(task);
+
+					last = task;
+				}
+
+				worker->SubmitTask(first);
+				worker->WaitOnTask(last);
+
+				test_loop_end_test;
+			}
+			test_loop_print_result("Dependency chain" << " - " << ((F64)_avg__ / (F64)0x10000) << " ns/task");
+
+			if (failed || counter.load(std::memory_order_relaxed) != 0x10000)
+				std::cout << "Dependency chain ran out of order!\n";
+
+			std::cout << "Task nodes committed: " << taskSystem.nodeAllocator.taskNodeCount.load() <<
+				", high-water mark: " << taskSystem.nodeAllocator.HighWaterMark() << "\n";
+
+			Free(links);
+		}
+
+		// ParallelFor / ParallelReduce
+		std::cout <<
+			"\n"
+			"ParallelReduce test, sum of squares against a serial loop.\n"
+			"\n";
+
+		U32* values = Allocate<U32>(0x1000000);
+		ScaleBody scale;
+		scale.values = values;
+
+		for (U32 i = 0; i < 0x1000000; i++)
+			values[i] = i;
+
+		ParallelFor(worker, 0, 0x1000000, 0x400, scale);
+
+		for (U32 i = 0; i < 0x1000000; i++)
+		{
+			if (values[i] != i * 3 + 1)
+			{
+				std::cout << "ParallelFor result mismatch!\n";
+				break;
+			}
+		}
+
+		ParallelReduceBenchmark(worker, values, 0x400);
+		ParallelReduceBenchmark(worker, values, 0x1000000);
+		Free(values);
+
+		// Priorities
+		std::cout <<
+			"\n"
+			"Priority test, submit-to-start latency of a probe every 100us under a saturating load (ns).\n"
+			"\n";
+
+		PriorityLatencyBenchmark(worker, taskSystem.workerCount, "Normal probe, normal load",
+			TaskPriority::TPNormal, TaskPriority::TPNormal);
+		PriorityLatencyBenchmark(worker, taskSystem.workerCount, "High probe, background load",
+			TaskPriority::TPBackground, TaskPriority::TPHigh);
+
+#if defined(__cpp_impl_coroutine)
+		// Coroutines
+		std::cout <<
+			"\n"
+			"Coroutine test, co_await on task handles and child coroutines.\n"
+			"\n";
+
+		CoroutineBenchmark(worker);
+#endif
+
+		// Closures
+		std::cout <<
+			"\n"
+			"Closure test, counting tasks with heap allocated args against closures stored in the task node.\n"
+			"\n";
+
+		ClosureBenchmark(worker, "All workers");
+
+		{
+			HelperTaskSystemConfig config;
+			config.workerCount = 1;
+
+			WorkerBase* singleWorker;
+			HelperTaskSystem singleTaskSystem(config, &singleWorker);
+
+			ClosureBenchmark(singleWorker, "Single worker");
+		}
+
+		// Nesting
+		std::cout <<
+			"\n"
+			"Nesting test, running tasks spawn children of themselves, 0x400000 elements.\n"
+			"\n";
+
+		QuickSortBenchmark(worker);
+		MergeSortBenchmark(worker);
+
+#if defined(CPP_HAS_EXCEPTIONS)
+		// Errors
+		std::cout <<
+			"\n"
+			"Error test, a throwing child fails its parent and cancels the children that did not start yet.\n"
+			"\n";
+
+		ErrorTest(worker, 0);
+		ErrorTest(worker, 1);
+		TreeFailureTest(worker);
+		SkippedParentTest(worker);
+		ParallelReduceErrorTest(worker);
+#endif
+
+		// Cancellation
+		std::cout <<
+			"\n"
+			"Cancellation test, a request is canceled while its tasks run.\n"
+			"\n";
+
+		CancellationTest(worker);
+		CancelParallelForTest(worker);
+
+		// Timers
+		std::cout <<
+			"\n"
+			"Timer test, idle workers park until the next timer is due.\n"
+			"\n";
+
+		TimerTest(worker);
+
+#if defined(BUILD_SCHEDULER_STATS)
+		std::cout << "\nScheduler stats of the task system above.\n\n";
+		taskSystem.PrintStats(std::cout);
+#endif
+
+#if defined(BUILD_SCHEDULER_TRACE)
+		if (taskSystem.WriteChromeTrace("HelperTaskSystem.trace.json"))
+			std::cout << "\nWrote the newest task events of every worker to HelperTaskSystem.trace.json.\n";
+#endif
 
 		// Submit example task
 		const char* text = "\nExampleTask: Hello World!\n";
@@ -64,4 +1271,75 @@ int main(int argc, char** args)
 		TaskHandle task = worker->NewTask(&ExampleTask, (void*)text, TaskHandle(), TaskHandle());
 		worker->SubmitTask(task);
 	}
+
+	std::cout <<
+		"\n"
+		"Configured task system, helpers pinned one per cpu, the main thread stays unpinned.\n"
+		"\n";
+
+	{
+		U32 cpuCount = std::thread::hardware_concurrency();
+
+		if (cpuCount == 0)
+			cpuCount = 1;
+
+		HelperTaskSystemConfig config;
+		config.workerCount = cpuCount < 4 ? 4 : cpuCount;
+		config.spinNanoseconds = 50000;
+
+		CpuMask* affinity = Allocate<CpuMask>(config.workerCount);
+
+		for (U32 i = 0; i < config.workerCount; i++)
+		{
+			new (affinity + i) CpuMask();
+
+			if (i != 0)
+				affinity[i].Set((i - 1) % cpuCount);
+		}
+
+		config.affinity = affinity;
+
+		WorkerBase* worker;
+		HelperTaskSystem taskSystem(config, &worker);
+		std::atomic<U32> counter(0);
+
+		test_loop(0x10)
+		{
+			test_loop_begin_test;
+
+			counter.store(0, std::memory_order_relaxed);
+
+			for (U32 i = 0; i < 0x100000; i++)
+			{
+				TaskHandle task = worker->NewTask(&CountTask, &counter, TaskHandle(), TaskHandle());
+				worker->SubmitTask(task);
+			}
+
+			while (counter.load(std::memory_order_relaxed) != 0x100000)
+				std::this_thread::yield();
+
+			test_loop_end_test;
+		}
+		test_loop_print_result("Pinned HelperTaskSystem" << " - " << ((F64)_avg__ / (F64)0x100000) << " ns/task");
+
+		Free(affinity);
+	}
+
+	std::cout <<
+		"\n"
+		"External submitter test, other threads submit through their own slots while the main thread\n"
+		"runs tasks until all of them ran.\n"
+		"\n";
+
+	ExternalSubmitterTest();
+
+	std::cout <<
+		"\n"
+		"Wake latency test, time from Futex::WakeSingle until the waiter runs (ns).\n"
+		"\n";
+
+	WakeLatencyBenchmark("Futex park, wake after 50us", 0, 50000);
+	WakeLatencyBenchmark("100us spin window, wake after 50us", 100000, 50000);
+	WakeLatencyBenchmark("Futex park, wake after 1ms", 0, 1000000);
+	WakeLatencyBenchmark("100us spin window, wake after 1ms", 100000, 1000000);
 }
\ No newline at end of file